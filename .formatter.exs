@@ -2,5 +2,5 @@
 [
   import_deps: [:nx],
   locals_without_parens: [deftensor: 1, defdevice: 1, defvalue: 1],
-  inputs: ["{mix,.formatter}.exs", "{config,lib,test}/**/*.{ex,exs}"]
+  inputs: ["{mix,.formatter}.exs", "{config,lib,test,bench}/**/*.{ex,exs}"]
 ]
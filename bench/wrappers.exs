@@ -0,0 +1,131 @@
+# Measures the Elixir glue of the generated EMLX wrappers on scalar-sized
+# tensors, where the glue dominates. Each wrapper is timed against the
+# code the macros generated before the fast clauses (Baseline below) and
+# against calling EMLX.NIF directly, and printed as one row of ns/call
+# per wrapper.
+#
+#     mix run bench/wrappers.exs
+
+defmodule Baseline do
+  # The bodies deftensor, defvalue and defdevice generated before the
+  # fast clauses, for the functions timed below. prepare_tensors! keeps
+  # only the clauses these calls can reach.
+  import EMLX, only: [is_tensor: 2]
+
+  def add(tensor_a, tensor_b) do
+    {[tensor_a, tensor_b], device} = prepare_tensors!([tensor_a, tensor_b])
+    EMLX.NIF.add(tensor_a, tensor_b, device) |> unwrap_tensor!(device)
+  end
+
+  def add(tensor_a, tensor_b, type, out_type) do
+    {[tensor_a, tensor_b], device} = prepare_tensors!([tensor_a, tensor_b])
+    EMLX.NIF.add(tensor_a, tensor_b, type, out_type, device) |> unwrap_tensor!(device)
+  end
+
+  def shape(tensor) do
+    {[tensor], _device} = prepare_tensors!([tensor])
+    EMLX.NIF.shape(tensor) |> unwrap!()
+  end
+
+  def scalar_tensor(scalar, type, device) do
+    {user_device, index} = normalize_device!(device)
+    device = mlx_device!(user_device, index)
+    EMLX.NIF.scalar_tensor(scalar, type, device) |> unwrap_tensor!(user_device)
+  end
+
+  defp unwrap!(:ok), do: :ok
+  defp unwrap!({:ok, result}), do: result
+  defp unwrap!({:error, error}), do: raise(EMLX.NIFError, List.to_string(error))
+
+  defp unwrap_tensor!(tagged_result, device) do
+    case unwrap!(tagged_result) do
+      ref when is_reference(ref) ->
+        {device, ref}
+
+      list when is_list(list) ->
+        Enum.map(list, &{device, &1})
+
+      tuple when is_tuple(tuple) ->
+        tuple |> Tuple.to_list() |> Enum.map(&{device, &1}) |> List.to_tuple()
+    end
+  end
+
+  defp prepare_tensors!(tensors) do
+    Enum.map_reduce(tensors, :cpu, fn
+      {dev, ref}, device when is_tensor(dev, ref) ->
+        {ref, merge_device(device, dev)}
+
+      scalar, device when is_number(scalar) ->
+        {scalar, device}
+
+      bad_tensor, _device ->
+        raise ArgumentError, "expected a EMLX tensor, got: #{inspect(bad_tensor)}"
+    end)
+  end
+
+  defp merge_device(:gpu, _), do: :gpu
+  defp merge_device(_, :gpu), do: :gpu
+  defp merge_device(_, _), do: :cpu
+
+  defp normalize_device!({device, index}) when is_atom(device) and is_integer(index),
+    do: {device, index}
+
+  defp normalize_device!(device) when is_atom(device), do: {device, -1}
+
+  defp mlx_device!(device, _index) do
+    case device do
+      :cpu -> :cpu
+      :gpu -> :gpu
+      _ -> raise ArgumentError, "unknown device #{inspect(device)}"
+    end
+  end
+end
+
+iterations = 100_000
+
+{_, a_ref} = a = EMLX.scalar_tensor(1.0, :float32, :cpu)
+{_, b_ref} = b = EMLX.scalar_tensor(2.0, :float32, :cpu)
+
+# {wrapper, old glue, fast clauses, raw NIF}
+cases = [
+  {
+    "add/2",
+    fn -> Baseline.add(a, b) end,
+    fn -> EMLX.add(a, b) end,
+    fn -> EMLX.NIF.add(a_ref, b_ref, :cpu) end
+  },
+  {
+    "add/4",
+    fn -> Baseline.add(a, b, :float32, :float32) end,
+    fn -> EMLX.add(a, b, :float32, :float32) end,
+    fn -> EMLX.NIF.add(a_ref, b_ref, :float32, :float32, :cpu) end
+  },
+  {
+    "shape/1",
+    fn -> Baseline.shape(a) end,
+    fn -> EMLX.shape(a) end,
+    fn -> EMLX.NIF.shape(a_ref) end
+  },
+  {
+    "scalar_tensor/3",
+    fn -> Baseline.scalar_tensor(1.0, :float32, :cpu) end,
+    fn -> EMLX.scalar_tensor(1.0, :float32, :cpu) end,
+    fn -> EMLX.NIF.scalar_tensor(1.0, :float32, :cpu) end
+  }
+]
+
+time = fn fun ->
+  # Warm up before timing
+  Enum.each(1..1_000, fn _ -> fun.() end)
+
+  {us, _} = :timer.tc(fn -> Enum.each(1..iterations, fn _ -> fun.() end) end)
+  us * 1000 / iterations
+end
+
+column = &String.pad_leading(&1, 14)
+IO.puts(String.pad_trailing("ns/call", 18) <> Enum.map_join(~w(old fast nif), &column.(&1)))
+
+for {name, old, fast, nif} <- cases do
+  times = Enum.map([old, fast, nif], &"#{Float.round(time.(&1), 1)}")
+  IO.puts(String.pad_trailing(name, 18) <> Enum.map_join(times, column))
+end
@@ -3,9 +3,24 @@
 #include "mlx/mlx.h"
 #include "nx_nif_utils.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 
 using namespace mlx::core;
 
@@ -16,6 +31,9 @@ std::map<const std::string, const mlx::core::Dtype> dtypes = {
     {"int16", mlx::core::int16},        {"int32", mlx::core::int32},
     {"int64", mlx::core::int64},        {"float16", mlx::core::float16},
     {"float32", mlx::core::float32},    {"bfloat16", mlx::core::bfloat16},
+#ifdef EMLX_HAS_FLOAT64
+    {"float64", mlx::core::float64},
+#endif
     {"complex64", mlx::core::complex64}};
 
 std::map<const std::string, const uint8_t> dtype_sizes = {
@@ -31,6 +49,9 @@ std::map<const std::string, const uint8_t> dtype_sizes = {
     {"float16", mlx::core::float16.size()},
     {"float32", mlx::core::float32.size()},
     {"bfloat16", mlx::core::bfloat16.size()},
+#ifdef EMLX_HAS_FLOAT64
+    {"float64", mlx::core::float64.size()},
+#endif
     {"complex64", mlx::core::complex64.size()}};
 
 inline mlx::core::Dtype string2dtype(const std::string &atom) {
@@ -59,6 +80,26 @@ inline const mlx::core::Device string2device(const std::string &atom) {
   throw std::runtime_error("Unknown device: " + atom);
 }
 
+// Skips identity casts
+inline mlx::core::array maybe_astype(const mlx::core::array &t,
+                                     const mlx::core::Dtype type,
+                                     const mlx::core::Device &device) {
+  return t.dtype() == type ? t : mlx::core::astype(t, type, device);
+}
+
+// float64 is only implemented by the MLX CPU backend, so arrays that
+// live on the GPU are created in float32 instead.
+inline mlx::core::Dtype device_dtype(const mlx::core::Dtype type,
+                                     const mlx::core::Device &device) {
+#ifdef EMLX_HAS_FLOAT64
+  if (type == mlx::core::float64 &&
+      device.type == mlx::core::Device::DeviceType::gpu) {
+    return mlx::core::float32;
+  }
+#endif
+  return type;
+}
+
 // Class to manage the refcount of MLX tensors
 class TensorP {
 public:
@@ -154,6 +195,16 @@ create_tensor_resource(ErlNifEnv *env, mlx::core::array tensor) {
   return ret;
 }
 
+static ERL_NIF_TERM tensor_list(ErlNifEnv *env,
+                                const std::vector<mlx::core::array> &arrays) {
+  std::vector<ERL_NIF_TERM> terms;
+  for (const auto &array : arrays) {
+    terms.push_back(create_tensor_resource(env, array));
+  }
+  return nx::nif::ok(
+      env, enif_make_list_from_array(env, terms.data(), terms.size()));
+}
+
 #define NIF(NAME)                                                              \
   ERL_NIF_TERM NAME(ErlNifEnv *env, int argc, const ERL_NIF_TERM argv[])
 
@@ -211,7 +262,7 @@ NIF(ones) {
   TYPE_PARAM(1, type);
   DEVICE_PARAM(2, device);
 
-  TENSOR(mlx::core::ones(shape, type, device));
+  TENSOR(mlx::core::ones(shape, device_dtype(type, device), device));
 }
 
 NIF(zeros) {
@@ -219,7 +270,7 @@ NIF(zeros) {
   TYPE_PARAM(1, type);
   DEVICE_PARAM(2, device);
 
-  TENSOR(mlx::core::zeros(shape, type, device));
+  TENSOR(mlx::core::zeros(shape, device_dtype(type, device), device));
 }
 
 NIF(reshape) {
@@ -235,72 +286,166 @@ NIF(astype) {
   TYPE_PARAM(1, type);
   DEVICE_PARAM(2, device);
 
-  TENSOR(mlx::core::astype(*t, type, device));
+  TENSOR(mlx::core::astype(*t, device_dtype(type, device), device));
+}
+
+// Copies `num_elements` elements of an evaluated array into `dst` in
+// row-major order, converting each element from SrcT to DstT on the way.
+template <typename SrcT, typename DstT>
+void strided_copy(const mlx::core::array &src, void *dst,
+                  size_t num_elements) {
+  const SrcT *src_data = src.data<SrcT>();
+  DstT *dst_data = static_cast<DstT *>(dst);
+
+  if (src.flags().row_contiguous) {
+    if constexpr (std::is_same_v<SrcT, DstT>) {
+      std::memcpy(dst_data, src_data, num_elements * sizeof(DstT));
+    } else {
+      for (size_t i = 0; i < num_elements; i++) {
+        dst_data[i] = static_cast<DstT>(src_data[i]);
+      }
+    }
+    return;
+  }
+
+  // The MLX array data may not be contiguous in memory. See:
+  // https://github.com/ml-explore/mlx/discussions/1608#discussioncomment-11332071
+  std::vector<int> slice_sizes(src.shape().begin(), src.shape().end());
+  ContiguousIterator<size_t> iterator(slice_sizes, src.strides(), src.ndim());
+
+  for (size_t i = 0; i < num_elements; i++) {
+    dst_data[i] = static_cast<DstT>(src_data[iterator.loc]);
+    iterator.step();
+  }
+}
+
+// Copies without conversion, dispatching only on the element size.
+void strided_copy_raw(const mlx::core::array &src, void *dst,
+                      size_t num_elements) {
+  switch (src.itemsize()) {
+  case 1:
+    return strided_copy<uint8_t, uint8_t>(src, dst, num_elements);
+  case 2:
+    return strided_copy<uint16_t, uint16_t>(src, dst, num_elements);
+  case 4:
+    return strided_copy<uint32_t, uint32_t>(src, dst, num_elements);
+  case 8:
+    return strided_copy<uint64_t, uint64_t>(src, dst, num_elements);
+  default:
+    throw std::runtime_error("Unsupported element size in to_blob");
+  }
+}
+
+// Output types to_blob can convert into while copying. float64 is always
+// available as a download target, even when MLX was built without it.
+void strided_copy_as(const mlx::core::array &src, const std::string &out_type,
+                     void *dst, size_t num_elements) {
+  auto src_type = src.dtype();
+
+  if (out_type == "float64") {
+    switch (src_type) {
+#ifdef EMLX_HAS_FLOAT64
+    case float64:
+      return strided_copy_raw(src, dst, num_elements);
+#endif
+    case float16:
+      return strided_copy<float16_t, double>(src, dst, num_elements);
+    case bfloat16:
+      return strided_copy<bfloat16_t, double>(src, dst, num_elements);
+    case float32:
+      return strided_copy<float, double>(src, dst, num_elements);
+    default:
+      break;
+    }
+  } else {
+    auto dst_type = string2dtype(out_type);
+
+    if (dst_type == src_type || (src_type == bool_ && dst_type == uint8)) {
+      return strided_copy_raw(src, dst, num_elements);
+    }
+
+    if (dst_type == float32) {
+      switch (src_type) {
+      case float16:
+        return strided_copy<float16_t, float>(src, dst, num_elements);
+      case bfloat16:
+        return strided_copy<bfloat16_t, float>(src, dst, num_elements);
+      default:
+        break;
+      }
+    }
+  }
+
+  throw std::runtime_error("Unsupported conversion in to_blob from " +
+                           *dtype2string(src_type) + " to " + out_type);
+}
+
+inline size_t blob_itemsize(const std::string &out_type) {
+  if (out_type == "float64") {
+    return sizeof(double);
+  }
+  return string2dtype(out_type).size();
+}
+
+NIF(float64_supported) {
+#ifdef EMLX_HAS_FLOAT64
+  return nx::nif::ok(env, nx::nif::make(env, true));
+#else
+  return nx::nif::ok(env, nx::nif::make(env, false));
+#endif
 }
 
 NIF(to_blob) {
   ERL_NIF_TERM result;
   TENSOR_PARAM(0, t);
 
-  size_t byte_size = t->nbytes();
-  int limit = 0;
-  bool has_received_limit = (argc == 2);
+  size_t num_elements = t->size();
 
-  if (has_received_limit) {
-    PARAM(1, int, param_limit);
-    limit = param_limit;
-    byte_size = limit * t->itemsize();
+  if (argc >= 2) {
+    PARAM(1, int64_t, limit);
+    num_elements =
+        std::min(num_elements, static_cast<size_t>(std::max<int64_t>(limit, 0)));
   }
 
-  // Flatten and slice if needed
-  mlx::core::array flattened = mlx::core::flatten(*t);
-  mlx::core::array reshaped =
-      (has_received_limit && byte_size < t->nbytes())
-          ? mlx::core::slice(flattened, std::vector<int>{0},
-                             std::vector<int>{limit})
-          : flattened;
+  std::string out_type = *dtype2string(t->dtype());
 
-  // Evaluate to ensure data is available
-  mlx::core::eval(reshaped);
+  if (argc == 3) {
+    ATOM_PARAM(2, out_type_atom);
+    out_type = out_type_atom;
+  }
 
-  // Create result binary
-  void *result_data = (void *)enif_make_new_binary(env, byte_size, &result);
+  try {
+    // Evaluate to ensure data is available
+    mlx::core::eval(*t);
 
-  // The MLX array data may not be contiguous in memory, even after the
-  // reshape+flatten operations. See:
-  // https://github.com/ml-explore/mlx/discussions/1608#discussioncomment-11332071
-  //
-  // Set up contiguous iterator
-  std::vector<int> slice_sizes(reshaped.shape().begin(),
-                               reshaped.shape().end());
-  ContiguousIterator<size_t> iterator(slice_sizes, reshaped.strides(),
-                                      reshaped.ndim());
-
-  // Copy data element by element using iterator
-  size_t element_size = reshaped.itemsize();
-  const char *src_data = static_cast<const char *>(reshaped.data<void>());
-  char *dst_data = static_cast<char *>(result_data);
-
-  size_t num_elements = byte_size / element_size;
-  for (size_t i = 0; i < num_elements; i++) {
-    size_t src_offset = iterator.loc;
-    std::memcpy(dst_data + (i * element_size),
-                src_data + (src_offset * element_size), element_size);
-    iterator.step();
+    size_t byte_size = num_elements * blob_itemsize(out_type);
+    void *result_data = (void *)enif_make_new_binary(env, byte_size, &result);
+
+    strided_copy_as(*t, out_type, result_data, num_elements);
+
+    return nx::nif::ok(env, result);
   }
+  CATCH()
+}
 
-  return nx::nif::ok(env, result);
+uint64_t elem_count(const std::vector<int> &shape) {
+  return std::accumulate(shape.begin(), shape.end(), uint64_t{1},
+                         std::multiplies<>{});
 }
 
-uint64_t elem_count(std::vector<int> shape) {
-  return std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<>{});
+// Flattened sizes must still fit in a single 32-bit MLX dimension
+int flat_dim(uint64_t size) {
+  if (size > static_cast<uint64_t>(std::numeric_limits<int>::max()))
+    throw std::runtime_error("Size " + std::to_string(size) +
+                             " does not fit in a 32-bit MLX dimension");
+  return static_cast<int>(size);
 }
 
 NIF(from_blob) {
   BINARY_PARAM(0, blob);
   SHAPE_PARAM(1, shape);
   TYPE_PARAM(2, type);
-  // DEVICE_PARAM(3, device);
+  DEVICE_PARAM(3, device);
 
   if (blob.size / dtype_sizes[type_atom] < elem_count(shape))
     return nx::nif::error(env,
@@ -318,8 +463,18 @@ NIF(from_blob) {
     // Create deleter for the buffer
     auto deleter = [](allocator::Buffer buf) { allocator::free(buf); };
 
-    // Create MLX array from the buffer
-    TENSOR(mlx::core::array(mlx_buf, shape, type, deleter));
+    // Create MLX array from the buffer, converting on the CPU when the
+    // type is not supported by the target device
+    auto result = mlx::core::array(mlx_buf, shape, type, deleter);
+    auto target_type = device_dtype(type, device);
+
+    if (target_type != type) {
+      result = mlx::core::astype(
+          result, target_type,
+          mlx::core::Device(mlx::core::Device::DeviceType::cpu, 0));
+    }
+
+    TENSOR(result);
   } catch (const std::exception &e) {
     return nx::nif::error(env, e.what());
   } catch (...) {
@@ -328,15 +483,81 @@ NIF(from_blob) {
   }
 }
 
+NIF(write_blob) {
+  TENSOR_PARAM(0, t);
+  BINARY_PARAM(1, blob);
+  LIST_PARAM(2, std::vector<int>, starts);
+  SHAPE_PARAM(3, shape);
+
+  size_t ndim = t->ndim();
+
+  if (starts.size() != ndim || shape.size() != ndim)
+    return nx::nif::error(env, "Starts and shape must match the tensor rank");
+
+  for (size_t axis = 0; axis < ndim; axis++) {
+    if (starts[axis] < 0 || shape[axis] < 0 ||
+        starts[axis] + shape[axis] > t->shape(axis))
+      return nx::nif::error(env, "Region is out of bounds for the tensor");
+  }
+
+  if (blob.size != elem_count(shape) * t->itemsize())
+    return nx::nif::error(env, "Binary size does not match the region shape");
+
+  try {
+    // Evaluate to ensure the buffer exists before writing into it
+    mlx::core::eval(*t);
+
+    // MLX arrays are immutable, so writing is only safe when nothing else
+    // (views, pending graphs or other arrays) can observe this buffer.
+    if (!t->is_donatable() || !t->flags().row_contiguous)
+      return nx::nif::error(env,
+                            "Tensor buffer is shared and cannot be written");
+
+    if (blob.size == 0)
+      return nx::nif::ok(env);
+
+    size_t itemsize = t->itemsize();
+    const auto &strides = t->strides();
+    char *dst_data = static_cast<char *>(t->data<void>());
+    const char *src_data = reinterpret_cast<const char *>(blob.data);
+
+    size_t base = 0;
+    for (size_t axis = 0; axis < ndim; axis++) {
+      base += starts[axis] * strides[axis];
+    }
+
+    if (ndim == 0) {
+      std::memcpy(dst_data, src_data, itemsize);
+      return nx::nif::ok(env);
+    }
+
+    // Copy the region one innermost row at a time
+    size_t row_bytes = shape.back() * itemsize;
+    size_t num_rows = elem_count(shape) / shape.back();
+    std::vector<int> row_shape(shape.begin(), shape.end() - 1);
+    ContiguousIterator<size_t> iterator(row_shape, strides, ndim - 1);
+
+    for (size_t row = 0; row < num_rows; row++) {
+      std::memcpy(dst_data + (base + iterator.loc) * itemsize,
+                  src_data + row * row_bytes, row_bytes);
+      if (row + 1 < num_rows)
+        iterator.step();
+    }
+
+    return nx::nif::ok(env);
+  }
+  CATCH()
+}
+
 NIF(scalar_tensor) {
   SCALAR_PARAM(0, scalar, is_complex);
   TYPE_PARAM(1, type);
-  // DEVICE_PARAM(2, device);
+  DEVICE_PARAM(2, device);
 
   if (is_complex) {
     TENSOR(mlx::core::array(complex_scalar, type))
   } else {
-    TENSOR(mlx::core::array(scalar, type))
+    TENSOR(mlx::core::array(scalar, device_dtype(type, device)))
   }
 }
 
@@ -349,19 +570,31 @@ NIF(full) {
   if (is_complex) {
     TENSOR(mlx::core::full(shape, complex_scalar, type, device));
   } else {
-    TENSOR(mlx::core::full(shape, scalar, type, device));
+    TENSOR(mlx::core::full(shape, scalar, device_dtype(type, device), device));
   }
 }
 
 NIF(arange) {
-  PARAM(0, int, start);
-  PARAM(1, int, stop);
-  PARAM(2, int, step);
+  PARAM(0, int64_t, start);
+  PARAM(1, int64_t, stop);
+  PARAM(2, int64_t, step);
   PARAM(3, bool, integer);
   DEVICE_PARAM(4, device);
 
-  if (integer) {
-    TENSOR(mlx::core::arange(start, stop, step, device));
+  auto fits_int = [](int64_t value) {
+    return value >= std::numeric_limits<int>::min() &&
+           value <= std::numeric_limits<int>::max();
+  };
+
+  if (integer && fits_int(start) && fits_int(stop) && fits_int(step)) {
+    TENSOR(mlx::core::arange(static_cast<int>(start), static_cast<int>(stop),
+                             static_cast<int>(step), device));
+  } else if (integer) {
+    // Bounds past the int range produce int64 values
+    TENSOR(mlx::core::arange(static_cast<double>(start),
+                             static_cast<double>(stop),
+                             static_cast<double>(step), mlx::core::int64,
+                             device));
   } else {
     TENSOR(mlx::core::arange(static_cast<double>(start),
                              static_cast<double>(stop),
@@ -375,7 +608,7 @@ NIF(eye) {
   TYPE_PARAM(2, type);
   DEVICE_PARAM(3, device);
 
-  TENSOR(mlx::core::eye(m, n, 0, type, device));
+  TENSOR(mlx::core::eye(m, n, 0, device_dtype(type, device), device));
 }
 
 NIF(broadcast_to) {
@@ -398,19 +631,365 @@ NIF(tensordot) {
   TENSOR(mlx::core::tensordot(*a, *b, axes1, axes2, device));
 }
 
-NIF(einsum) {
+// Both operands are cast to compute_type and the product to out_type in
+// the same call. MLX only multiplies floating point matrices, so integer
+// dots pass a floating point compute_type.
+NIF(matmul) {
+  TENSOR_PARAM(0, a);
+  TENSOR_PARAM(1, b);
+  TYPE_PARAM(2, compute_type);
+  TYPE_PARAM(3, out_type);
+  DEVICE_PARAM(4, device);
+
+  try {
+    auto compute = device_dtype(compute_type, device);
+    auto result =
+        mlx::core::matmul(maybe_astype(*a, compute, device),
+                          maybe_astype(*b, compute, device), device);
+    TENSOR(maybe_astype(result, device_dtype(out_type, device), device));
+  }
+  CATCH()
+}
+
+// beta * c + alpha * (a @ b), with c broadcast to the product's shape
+NIF(addmm) {
+  TENSOR_PARAM(0, c);
+  TENSOR_PARAM(1, a);
+  TENSOR_PARAM(2, b);
+  PARAM(3, double, alpha);
+  PARAM(4, double, beta);
+  TYPE_PARAM(5, compute_type);
+  TYPE_PARAM(6, out_type);
+  DEVICE_PARAM(7, device);
+
+  try {
+    auto compute = device_dtype(compute_type, device);
+    auto result = mlx::core::addmm(
+        maybe_astype(*c, compute, device), maybe_astype(*a, compute, device),
+        maybe_astype(*b, compute, device), alpha, beta, device);
+    TENSOR(maybe_astype(result, device_dtype(out_type, device), device));
+  }
+  CATCH()
+}
+
+// Multiplies the matrices a[lhs_indices] and b[rhs_indices] in a single
+// kernel. The indices select matrices from the flattened batch axes of
+// each operand and broadcast against each other.
+NIF(gather_mm) {
   TENSOR_PARAM(0, a);
   TENSOR_PARAM(1, b);
+  TENSOR_PARAM(2, lhs_indices);
+  TENSOR_PARAM(3, rhs_indices);
+  TYPE_PARAM(4, compute_type);
+  TYPE_PARAM(5, out_type);
+  DEVICE_PARAM(6, device);
+
+  try {
+    auto compute = device_dtype(compute_type, device);
+    auto result = mlx::core::gather_mm(
+        maybe_astype(*a, compute, device), maybe_astype(*b, compute, device),
+        maybe_astype(*lhs_indices, mlx::core::uint32, device),
+        maybe_astype(*rhs_indices, mlx::core::uint32, device), device);
+    TENSOR(maybe_astype(result, device_dtype(out_type, device), device));
+  }
+  CATCH()
+}
+
+// An einsum plan lowers the contraction path for one spec and set of
+// operand shapes to sum, transpose, reshape and matmul steps, so repeated
+// calls skip both subscript parsing and the path search. Specs the planner
+// does not handle (implicit output, ellipsis, repeated or broadcast labels)
+// are marked native and go through mlx::core::einsum as before.
+struct EinsumStep {
+  int lhs, rhs;
+  std::vector<int> sum_axes[2];
+  std::vector<int> perm[2];
+  std::vector<int> shape[2];
+  std::vector<int> out_shape;
+};
+
+struct EinsumPlan {
+  bool native = false;
+  std::vector<EinsumStep> steps;
+  std::vector<int> out_perm;
+};
+
+static bool is_identity(const std::vector<int> &perm) {
+  for (size_t i = 0; i < perm.size(); i++) {
+    if (perm[i] != static_cast<int>(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Sums away the labels missing from `order`, then permutes and flattens
+// the rest into the given groups
+static void plan_einsum_side(const std::string &labels,
+                             const std::string &order,
+                             const std::vector<std::string> &groups,
+                             const std::map<char, int> &sizes, int side,
+                             EinsumStep &step) {
+  std::string kept;
+  for (size_t axis = 0; axis < labels.size(); axis++) {
+    if (order.find(labels[axis]) == std::string::npos) {
+      step.sum_axes[side].push_back(axis);
+    } else {
+      kept += labels[axis];
+    }
+  }
+
+  for (char label : order) {
+    step.perm[side].push_back(kept.find(label));
+  }
+
+  for (size_t g = 0; g < groups.size(); g++) {
+    // The first group holds the batch labels, which stay separate
+    if (g == 0) {
+      for (char label : groups[g]) {
+        step.shape[side].push_back(sizes.at(label));
+      }
+    } else {
+      int size = 1;
+      for (char label : groups[g]) {
+        size *= sizes.at(label);
+      }
+      step.shape[side].push_back(size);
+    }
+  }
+}
+
+static EinsumPlan plan_einsum(const std::string &spec,
+                              const std::vector<mlx::core::array> &operands) {
+  EinsumPlan plan;
+  auto arrow = spec.find("->");
+
+  if (operands.size() < 2 || arrow == std::string::npos ||
+      spec.find('.') != std::string::npos) {
+    plan.native = true;
+    return plan;
+  }
+
+  std::vector<std::string> labels;
+  std::string inputs = spec.substr(0, arrow);
+  std::string output = spec.substr(arrow + 2);
+
+  for (size_t start = 0;;) {
+    auto comma = inputs.find(',', start);
+    labels.push_back(inputs.substr(start, comma - start));
+    if (comma == std::string::npos) {
+      break;
+    }
+    start = comma + 1;
+  }
+
+  if (labels.size() != operands.size()) {
+    plan.native = true;
+    return plan;
+  }
+
+  std::map<char, int> sizes;
+  for (size_t i = 0; i < operands.size(); i++) {
+    const auto &shape = operands[i].shape();
+    if (labels[i].size() != shape.size()) {
+      plan.native = true;
+      return plan;
+    }
+
+    for (size_t axis = 0; axis < shape.size(); axis++) {
+      char label = labels[i][axis];
+      auto size = sizes.find(label);
+
+      if (labels[i].find(label) != axis ||
+          (size != sizes.end() && size->second != shape[axis])) {
+        plan.native = true;
+        return plan;
+      }
+      sizes[label] = shape[axis];
+    }
+  }
+
+  std::vector<std::vector<int>> path;
+  if (operands.size() == 2) {
+    path.push_back({0, 1});
+  } else {
+    path = mlx::core::einsum_path(spec, operands).first;
+  }
+
+  for (const auto &contraction : path) {
+    if (contraction.size() != 2) {
+      plan.native = true;
+      return plan;
+    }
+
+    EinsumStep step;
+    step.lhs = contraction[0];
+    step.rhs = contraction[1];
+    const std::string lhs = labels[step.lhs];
+    const std::string rhs = labels[step.rhs];
+
+    // Labels still referenced after this step must survive it
+    std::string needed = output;
+    for (size_t i = 0; i < labels.size(); i++) {
+      if (static_cast<int>(i) != step.lhs && static_cast<int>(i) != step.rhs) {
+        needed += labels[i];
+      }
+    }
+
+    std::string batch, contract, lhs_free, rhs_free;
+    for (char label : lhs) {
+      bool kept = needed.find(label) != std::string::npos;
+      if (rhs.find(label) != std::string::npos) {
+        (kept ? batch : contract) += label;
+      } else if (kept) {
+        lhs_free += label;
+      }
+    }
+    for (char label : rhs) {
+      if (lhs.find(label) == std::string::npos &&
+          needed.find(label) != std::string::npos) {
+        rhs_free += label;
+      }
+    }
+
+    plan_einsum_side(lhs, batch + lhs_free + contract,
+                     {batch, lhs_free, contract}, sizes, 0, step);
+    plan_einsum_side(rhs, batch + contract + rhs_free,
+                     {batch, contract, rhs_free}, sizes, 1, step);
+
+    std::string result = batch + lhs_free + rhs_free;
+    for (char label : result) {
+      step.out_shape.push_back(sizes.at(label));
+    }
+
+    labels.erase(labels.begin() + std::max(step.lhs, step.rhs));
+    labels.erase(labels.begin() + std::min(step.lhs, step.rhs));
+    labels.push_back(result);
+    plan.steps.push_back(std::move(step));
+  }
+
+  if (labels.size() != 1 || labels[0].size() != output.size()) {
+    plan.native = true;
+    return plan;
+  }
+
+  for (char label : output) {
+    auto axis = labels[0].find(label);
+    if (axis == std::string::npos) {
+      plan.native = true;
+      return plan;
+    }
+    plan.out_perm.push_back(axis);
+  }
+
+  return plan;
+}
+
+static mlx::core::array run_einsum_plan(const EinsumPlan &plan,
+                                        const std::string &spec,
+                                        std::vector<mlx::core::array> operands,
+                                        const mlx::core::Device &device) {
+  if (plan.native) {
+    return mlx::core::einsum(spec, operands, device);
+  }
+
+  for (const auto &step : plan.steps) {
+    std::vector<mlx::core::array> sides;
+
+    for (int side = 0; side < 2; side++) {
+      auto t = operands[side == 0 ? step.lhs : step.rhs];
+      if (!step.sum_axes[side].empty()) {
+        t = mlx::core::sum(t, step.sum_axes[side], false, device);
+      }
+      if (!is_identity(step.perm[side])) {
+        t = mlx::core::transpose(t, step.perm[side], device);
+      }
+      sides.push_back(mlx::core::reshape(t, step.shape[side], device));
+    }
+
+    auto result = mlx::core::reshape(
+        mlx::core::matmul(sides[0], sides[1], device), step.out_shape, device);
+
+    operands.erase(operands.begin() + std::max(step.lhs, step.rhs));
+    operands.erase(operands.begin() + std::min(step.lhs, step.rhs));
+    operands.push_back(result);
+  }
+
+  if (is_identity(plan.out_perm)) {
+    return operands[0];
+  }
+  return mlx::core::transpose(operands[0], plan.out_perm, device);
+}
+
+// LRU of einsum plans keyed on the spec and the operand shapes. NIFs run
+// on any scheduler thread, so lookups are serialized.
+class EinsumCache {
+public:
+  std::shared_ptr<const EinsumPlan>
+  get(const std::string &spec, const std::vector<mlx::core::array> &operands) {
+    std::string key = spec;
+    for (const auto &operand : operands) {
+      key += '|';
+      for (auto dim : operand.shape()) {
+        key += std::to_string(dim) + 'x';
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = index.find(key);
+      if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+      }
+    }
+
+    // Planning happens outside the lock; a racing miss plans twice and
+    // the second insert is dropped
+    auto plan =
+        std::make_shared<const EinsumPlan>(plan_einsum(spec, operands));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.find(key) == index.end()) {
+      entries.emplace_front(key, plan);
+      index[key] = entries.begin();
+      if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+    }
+    return plan;
+  }
+
+private:
+  static constexpr size_t capacity = 256;
+  std::mutex mutex;
+  std::list<std::pair<std::string, std::shared_ptr<const EinsumPlan>>>
+      entries;
+  std::unordered_map<
+      std::string,
+      std::list<std::pair<std::string,
+                          std::shared_ptr<const EinsumPlan>>>::iterator>
+      index;
+};
+
+static EinsumCache einsum_cache;
+
+NIF(einsum) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, operands);
 
   std::string spec_string;
-  if (!nx::nif::get(env, argv[2], spec_string)) {
+  if (!nx::nif::get(env, argv[1], spec_string)) {
     return nx::nif::error(env, "Unable to get spec_string param.");
   }
 
-  DEVICE_PARAM(3, device);
+  DEVICE_PARAM(2, device);
 
-  TENSOR(mlx::core::einsum(spec_string, std::vector<mlx::core::array>({*a, *b}),
-                           device));
+  try {
+    auto plan = einsum_cache.get(spec_string, operands);
+    TENSOR(run_einsum_plan(*plan, spec_string, operands, device));
+  }
+  CATCH()
 }
 
 NIF(tri_inv) {
@@ -457,10 +1036,44 @@ NIF(pad) {
                         "constant", device))
 };
 
+// Reverses a along axis with a negative-stride slice (a view, no copy)
+static mlx::core::array reverse_axis(const mlx::core::array &a, int axis,
+                                     mlx::core::StreamOrDevice device) {
+  std::vector<int> starts(a.ndim(), 0);
+  std::vector<int> stops(a.shape().begin(), a.shape().end());
+  std::vector<int> strides(a.ndim(), 1);
+
+  starts[axis] = a.shape(axis) - 1;
+  stops[axis] = -a.shape(axis) - 1;
+  strides[axis] = -1;
+
+  return mlx::core::slice(a, starts, stops, strides, device);
+}
+
+// MLX only sorts in ascending order. Sorting the reversed input and
+// mapping the indices back keeps equal elements in their original order,
+// which negating the input would not (and it works for unsigned types).
+static mlx::core::array argsort_desc(const mlx::core::array &a, int axis,
+                                     mlx::core::StreamOrDevice device) {
+  auto indices =
+      mlx::core::argsort(reverse_axis(a, axis, device), axis, device);
+
+  return mlx::core::subtract(
+      mlx::core::array(a.shape(axis) - 1, indices.dtype()),
+      reverse_axis(indices, axis, device), device);
+}
+
 NIF(sort) {
   TENSOR_PARAM(0, t);
   PARAM(1, int, axis);
-  DEVICE_PARAM(2, device);
+  PARAM(2, bool, descending);
+  DEVICE_PARAM(3, device);
+
+  if (axis < 0)
+    axis += t->ndim();
+
+  if (descending)
+    TENSOR(reverse_axis(mlx::core::sort(*t, axis, device), axis, device));
 
   TENSOR(mlx::core::sort(*t, axis, device));
 }
@@ -468,68 +1081,220 @@ NIF(sort) {
 NIF(argsort) {
   TENSOR_PARAM(0, t);
   PARAM(1, int, axis);
-  DEVICE_PARAM(2, device);
-
-  TENSOR(mlx::core::argsort(*t, axis, device));
-}
+  PARAM(2, bool, descending);
+  DEVICE_PARAM(3, device);
 
-NIF(eval) {
-  TENSOR_PARAM(0, t);
-  mlx::core::eval(*t);
-  return nx::nif::ok(env);
-}
+  if (axis < 0)
+    axis += t->ndim();
 
-NIF(stack) {
-  LIST_PARAM(0, std::vector<mlx::core::array>, arrays);
-  PARAM(1, int, axis);
-  DEVICE_PARAM(2, device);
+  if (descending)
+    TENSOR(argsort_desc(*t, axis, device));
 
-  TENSOR(mlx::core::stack(arrays, axis, device));
+  TENSOR(mlx::core::argsort(*t, axis, device));
 }
 
-NIF(where) {
-  TENSOR_PARAM(0, condition);
-  TENSOR_PARAM(1, x);
-  TENSOR_PARAM(2, y);
+NIF(partition) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, kth);
+  PARAM(2, int, axis);
   DEVICE_PARAM(3, device);
 
-  TENSOR(mlx::core::where(*condition, *x, *y, device));
+  TENSOR(mlx::core::partition(*t, kth, axis, device));
 }
 
-NIF(concatenate) {
-  LIST_PARAM(0, std::vector<mlx::core::array>, arrays);
-  PARAM(1, int, axis);
-  DEVICE_PARAM(2, device);
+NIF(argpartition) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, kth);
+  PARAM(2, int, axis);
+  DEVICE_PARAM(3, device);
 
-  TENSOR(mlx::core::concatenate(arrays, axis, device));
+  TENSOR(mlx::core::argpartition(*t, kth, axis, device));
 }
 
-NIF(take_along_axis) {
+// The k largest values along axis, in descending order
+NIF(topk) {
   TENSOR_PARAM(0, t);
-  TENSOR_PARAM(1, indices);
+  PARAM(1, int, k);
   PARAM(2, int, axis);
   DEVICE_PARAM(3, device);
 
-  TENSOR(mlx::core::take_along_axis(*t, *indices, axis, device));
+  if (axis < 0)
+    axis += t->ndim();
+
+  if (k < 1 || k > t->shape(axis))
+    return nx::nif::error(env, "k must be between 1 and the axis size");
+
+  TENSOR(reverse_axis(
+      mlx::core::sort(mlx::core::topk(*t, k, axis, device), axis, device),
+      axis, device));
 }
 
-NIF(take) {
+// Indices of the k largest values along axis, ordered like a stable
+// descending argsort. Only k elements are sorted.
+//
+// argpartition alone picks an arbitrary subset of the values tied with
+// the k-th largest, so the candidates are chosen explicitly: everything
+// above the k-th value, then the lowest indices among the ties.
+NIF(argtopk) {
   TENSOR_PARAM(0, t);
-  TENSOR_PARAM(1, indices);
+  PARAM(1, int, k);
   PARAM(2, int, axis);
   DEVICE_PARAM(3, device);
 
-  TENSOR(mlx::core::take(*t, *indices, axis, device));
-}
+  if (axis < 0)
+    axis += t->ndim();
 
-NIF(gather) {
-  TENSOR_PARAM(0, t);
-  LIST_PARAM(1, std::vector<mlx::core::array>, indices);
-  LIST_PARAM(2, std::vector<int>, axes);
-  LIST_PARAM(3, std::vector<int>, slice_sizes);
-  DEVICE_PARAM(4, device);
+  if (k < 1 || k > t->shape(axis))
+    return nx::nif::error(env, "k must be between 1 and the axis size");
 
-  TENSOR(mlx::core::gather(*t, indices, axes, slice_sizes, device));
+  try {
+    auto n = t->shape(axis);
+    std::vector<int> starts(t->ndim(), 0);
+    std::vector<int> stops(t->shape().begin(), t->shape().end());
+
+    starts[axis] = n - k;
+    stops[axis] = n - k + 1;
+    auto kth = mlx::core::slice(mlx::core::partition(*t, n - k, axis, device),
+                                starts, stops, device);
+
+    auto greater = mlx::core::greater(*t, kth, device);
+    auto tied = mlx::core::equal(*t, kth, device);
+    auto needed = mlx::core::subtract(
+        mlx::core::array(k, mlx::core::int32),
+        mlx::core::sum(mlx::core::astype(greater, mlx::core::int32, device),
+                       axis, true, device),
+        device);
+    auto tie_rank = mlx::core::cumsum(
+        mlx::core::astype(tied, mlx::core::int32, device), axis, false, true,
+        device);
+    auto selected = mlx::core::logical_or(
+        greater,
+        mlx::core::logical_and(
+            tied, mlx::core::less_equal(tie_rank, needed, device), device),
+        device);
+
+    // Exactly k elements are selected, and they partition to the front
+    auto rejected =
+        mlx::core::astype(mlx::core::logical_not(selected, device),
+                          mlx::core::uint8, device);
+    auto candidates = mlx::core::argpartition(rejected, k - 1, axis, device);
+
+    starts[axis] = 0;
+    stops[axis] = k;
+
+    // Index order first, so the stable sort below breaks ties by index
+    candidates = mlx::core::sort(
+        mlx::core::slice(candidates, starts, stops, device), axis, device);
+
+    auto values = mlx::core::take_along_axis(*t, candidates, axis, device);
+    auto order = argsort_desc(values, axis, device);
+
+    return nx::nif::ok(
+        env, create_tensor_resource(env, mlx::core::take_along_axis(
+                                             candidates, order, axis, device)));
+  }
+  CATCH()
+}
+
+NIF(eval) {
+  TENSOR_PARAM(0, t);
+  mlx::core::eval(*t);
+  return nx::nif::ok(env);
+}
+
+/* Containers */
+
+// Bulk versions of astype, eval and copy over the flat list of leaves
+// of an Nx container, one NIF call instead of one per leaf
+
+NIF(astype_all) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, tensors);
+  TYPE_PARAM(1, type);
+  DEVICE_PARAM(2, device);
+
+  try {
+    auto dtype = device_dtype(type, device);
+    std::vector<mlx::core::array> results;
+    for (const auto &t : tensors) {
+      results.push_back(maybe_astype(t, dtype, device));
+    }
+    return tensor_list(env, results);
+  }
+  CATCH()
+}
+
+NIF(eval_all) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, tensors);
+
+  try {
+    mlx::core::eval(tensors);
+    return nx::nif::ok(env);
+  }
+  CATCH()
+}
+
+// New handles to the same arrays. MLX arrays are immutable, so sharing
+// them is a copy that deallocating either handle does not affect.
+NIF(share_all) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, tensors);
+
+  try {
+    return tensor_list(env, tensors);
+  }
+  CATCH()
+}
+
+NIF(stack) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, arrays);
+  PARAM(1, int, axis);
+  DEVICE_PARAM(2, device);
+
+  TENSOR(mlx::core::stack(arrays, axis, device));
+}
+
+NIF(where) {
+  TENSOR_PARAM(0, condition);
+  TENSOR_PARAM(1, x);
+  TENSOR_PARAM(2, y);
+  DEVICE_PARAM(3, device);
+
+  TENSOR(mlx::core::where(*condition, *x, *y, device));
+}
+
+NIF(concatenate) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, arrays);
+  PARAM(1, int, axis);
+  DEVICE_PARAM(2, device);
+
+  TENSOR(mlx::core::concatenate(arrays, axis, device));
+}
+
+NIF(take_along_axis) {
+  TENSOR_PARAM(0, t);
+  TENSOR_PARAM(1, indices);
+  PARAM(2, int, axis);
+  DEVICE_PARAM(3, device);
+
+  TENSOR(mlx::core::take_along_axis(*t, *indices, axis, device));
+}
+
+NIF(take) {
+  TENSOR_PARAM(0, t);
+  TENSOR_PARAM(1, indices);
+  PARAM(2, int, axis);
+  DEVICE_PARAM(3, device);
+
+  TENSOR(mlx::core::take(*t, *indices, axis, device));
+}
+
+NIF(gather) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<mlx::core::array>, indices);
+  LIST_PARAM(2, std::vector<int>, axes);
+  LIST_PARAM(3, std::vector<int>, slice_sizes);
+  DEVICE_PARAM(4, device);
+
+  TENSOR(mlx::core::gather(*t, indices, axes, slice_sizes, device));
 }
 
 NIF(scatter_add) {
@@ -552,15 +1317,56 @@ NIF(scatter) {
   TENSOR(mlx::core::scatter(*t, indices, *tensor_updates, axes, device));
 }
 
+NIF(scatter_max) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<mlx::core::array>, indices);
+  TENSOR_PARAM(2, tensor_updates);
+  LIST_PARAM(3, std::vector<int>, axes);
+  DEVICE_PARAM(4, device);
+
+  TENSOR(mlx::core::scatter_max(*t, indices, *tensor_updates, axes, device));
+}
+
+NIF(scatter_min) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<mlx::core::array>, indices);
+  TENSOR_PARAM(2, tensor_updates);
+  LIST_PARAM(3, std::vector<int>, axes);
+  DEVICE_PARAM(4, device);
+
+  TENSOR(mlx::core::scatter_min(*t, indices, *tensor_updates, axes, device));
+}
+
+NIF(scatter_prod) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<mlx::core::array>, indices);
+  TENSOR_PARAM(2, tensor_updates);
+  LIST_PARAM(3, std::vector<int>, axes);
+  DEVICE_PARAM(4, device);
+
+  TENSOR(mlx::core::scatter_prod(*t, indices, *tensor_updates, axes, device));
+}
+
 /* Reduction Ops */
 
 #define REDUCTION_AXES_OP(OP) REDUCTION_AXES_OP2(OP, OP)
 
+// With argc 5 the result is cast to the given output type in the same
+// call, and empty axes mean no reduction, as in Nx.
 #define REDUCTION_AXES_OP2(OP, NATIVE_OP)                                      \
   NIF(OP) {                                                                    \
     TENSOR_PARAM(0, tensor);                                                   \
     LIST_PARAM(1, std::vector<int>, axes);                                     \
     PARAM(2, bool, keep_dims);                                                 \
+                                                                               \
+    if (argc == 5) {                                                           \
+      TYPE_PARAM(3, out_type);                                                 \
+      DEVICE_PARAM(4, device);                                                 \
+      TENSOR(maybe_astype(                                                     \
+          mlx::core::NATIVE_OP(*tensor, axes, keep_dims, device),              \
+          device_dtype(out_type, device), device));                            \
+    }                                                                          \
+                                                                               \
     DEVICE_PARAM(3, device);                                                   \
                                                                                \
     if (axes.empty()) {                                                        \
@@ -571,102 +1377,1074 @@ NIF(scatter) {
     TENSOR(mlx::core::NATIVE_OP(*tensor, axes, keep_dims, device));            \
   }
 
-#define REDUCTION_AXIS_OP(OP) REDUCTION_AXIS_OP2(OP, OP)
+#define REDUCTION_AXIS_OP(OP) REDUCTION_AXIS_OP2(OP, OP)
+
+#define REDUCTION_AXIS_OP2(OP, NATIVE_OP)                                      \
+  NIF(OP) {                                                                    \
+    TENSOR_PARAM(0, tensor);                                                   \
+    if (argc == 3) {                                                           \
+      PARAM(1, bool, keep_dims);                                               \
+      DEVICE_PARAM(2, device);                                                 \
+      TENSOR(mlx::core::NATIVE_OP(*tensor, keep_dims, device));                \
+    } else {                                                                   \
+      PARAM(1, int, axis);                                                     \
+      PARAM(2, bool, keep_dims);                                               \
+      DEVICE_PARAM(3, device);                                                 \
+      TENSOR(mlx::core::NATIVE_OP(*tensor, axis, keep_dims, device));          \
+    }                                                                          \
+  }
+
+#define REDUCTION_AXIS_REVERSIBLE_OP(OP) REDUCTION_AXIS_REVERSIBLE_OP2(OP, OP)
+
+#define REDUCTION_AXIS_REVERSIBLE_OP2(OP, NATIVE_OP)                           \
+  NIF(OP) {                                                                    \
+    TENSOR_PARAM(0, tensor);                                                   \
+    PARAM(1, int, axis);                                                       \
+    PARAM(2, bool, keep_dims);                                                 \
+    DEVICE_PARAM(3, device);                                                   \
+                                                                               \
+    TENSOR(mlx::core::NATIVE_OP(*tensor, axis, keep_dims, device));            \
+  }
+
+REDUCTION_AXES_OP(all)
+REDUCTION_AXES_OP(any)
+REDUCTION_AXES_OP(sum)
+REDUCTION_AXES_OP2(product, prod)
+REDUCTION_AXIS_OP(argmax)
+REDUCTION_AXIS_OP(argmin)
+
+// Precise mode accumulates in float32 for half precision inputs
+NIF(softmax) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, axes);
+  DEVICE_PARAM(2, device);
+
+  TENSOR(mlx::core::softmax(*t, axes, true, device));
+}
+
+NIF(log_softmax) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, axes);
+  DEVICE_PARAM(2, device);
+
+  TENSOR(mlx::core::subtract(*t, mlx::core::logsumexp(*t, axes, true, device),
+                             device));
+}
+
+NIF(logsumexp) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, axes);
+  PARAM(2, bool, keep_axes);
+  DEVICE_PARAM(3, device);
+
+  TENSOR(mlx::core::logsumexp(*t, axes, keep_axes, device));
+}
+
+// Draws one token per row of logits [..., vocab]: the logits are scaled
+// by 1 / temperature, limited to the top_k largest and to the smallest
+// set whose probability reaches top_p, and sampled from. The result is
+// lazy, so nothing is synced to the host until it is read. temperature 0
+// picks the argmax, top_k 0 and top_p 1 disable the filters.
+NIF(sample_token) {
+  TENSOR_PARAM(0, logits);
+  TENSOR_PARAM(1, key);
+  PARAM(2, double, temperature);
+  PARAM(3, int, top_k);
+  PARAM(4, double, top_p);
+  DEVICE_PARAM(5, device);
+
+  try {
+    auto x = maybe_astype(*logits, mlx::core::float32, device);
+    int last = x.ndim() - 1;
+
+    if (temperature <= 0) {
+      TENSOR(mlx::core::astype(mlx::core::argmax(x, last, false, device),
+                               mlx::core::int32, device));
+    }
+
+    auto inf = std::numeric_limits<float>::infinity();
+    x = mlx::core::multiply(
+        x, mlx::core::array(static_cast<float>(1.0 / temperature)), device);
+
+    if (top_k > 0 && top_k < x.shape(last)) {
+      auto kth = mlx::core::min(mlx::core::topk(x, top_k, last, device), last,
+                                true, device);
+      x = mlx::core::where(mlx::core::less(x, kth, device),
+                           mlx::core::array(-inf), x, device);
+    }
+
+    if (top_p < 1.0) {
+      auto probs = mlx::core::softmax(x, std::vector<int>{last}, true, device);
+      auto sorted =
+          reverse_axis(mlx::core::sort(probs, last, device), last, device);
+
+      // An entry is kept while the mass before it is below top_p, so the
+      // most likely token always is
+      auto before = mlx::core::cumsum(sorted, last, false, false, device);
+      auto kept = mlx::core::where(
+          mlx::core::less(before,
+                          mlx::core::array(static_cast<float>(top_p)), device),
+          sorted, mlx::core::array(inf), device);
+      auto threshold = mlx::core::min(kept, last, true, device);
+
+      x = mlx::core::where(mlx::core::less(probs, threshold, device),
+                           mlx::core::array(-inf), x, device);
+    }
+
+    auto token = mlx::core::random::categorical(
+        x, last, maybe_astype(*key, mlx::core::uint32, device), device);
+    TENSOR(mlx::core::astype(token, mlx::core::int32, device));
+  }
+  CATCH()
+}
+
+NIF(cumulative_sum) {
+  TENSOR_PARAM(0, tensor);
+  PARAM(1, int, axis);
+  PARAM(2, bool, reverse);
+  PARAM(3, bool, inclusive);
+  DEVICE_PARAM(4, device);
+  TENSOR(mlx::core::cumsum(*tensor, axis, reverse, inclusive, device));
+}
+
+NIF(cumulative_product) {
+  TENSOR_PARAM(0, tensor);
+  PARAM(1, int, axis);
+  PARAM(2, bool, reverse);
+  PARAM(3, bool, inclusive);
+  DEVICE_PARAM(4, device);
+  TENSOR(mlx::core::cumprod(*tensor, axis, reverse, inclusive, device));
+}
+
+NIF(cumulative_max) {
+  TENSOR_PARAM(0, tensor);
+  PARAM(1, int, axis);
+  PARAM(2, bool, reverse);
+  PARAM(3, bool, inclusive);
+  DEVICE_PARAM(4, device);
+  TENSOR(mlx::core::cummax(*tensor, axis, reverse, inclusive, device));
+}
+
+NIF(cumulative_min) {
+  TENSOR_PARAM(0, tensor);
+  PARAM(1, int, axis);
+  PARAM(2, bool, reverse);
+  PARAM(3, bool, inclusive);
+  DEVICE_PARAM(4, device);
+  TENSOR(mlx::core::cummin(*tensor, axis, reverse, inclusive, device));
+}
+
+/* Unary Ops */
+
+#define UNARY_OP(OP) UNARY_OP2(OP, OP)
+
+#define UNARY_OP2(OP, NATIVE_OP)                                               \
+  NIF(OP) {                                                                    \
+    TENSOR_PARAM(0, tensor);                                                   \
+    DEVICE_PARAM(1, device);                                                   \
+                                                                               \
+    TENSOR(mlx::core::NATIVE_OP(*tensor, device));                             \
+  }
+
+/* Binary Ops */
+
+// An operand that is either a tensor or an Elixir number/{re, im} tuple.
+// Scalars become MLX scalars with the (promoted) dtype of the tensor they
+// are combined with, so no scalar_tensor call is needed for literals.
+struct Operand {
+  std::optional<mlx::core::array> tensor;
+  double scalar = 0;
+  std::complex<float> complex_scalar;
+  bool is_complex = false;
+  bool is_float = false;
+
+  // Like Python scalars in MLX, integers keep the dtype of the tensor,
+  // while floats promote integer and boolean tensors and complex numbers
+  // promote real ones
+  mlx::core::Dtype promote(const mlx::core::Dtype dtype) const {
+    if (is_complex && !mlx::core::issubdtype(dtype, mlx::core::complexfloating))
+      return mlx::core::promote_types(dtype, mlx::core::complex64);
+    if (is_float && !mlx::core::issubdtype(dtype, mlx::core::inexact))
+      return mlx::core::promote_types(dtype, mlx::core::float32);
+    return dtype;
+  }
+
+  mlx::core::array to_array(const mlx::core::Dtype dtype) const {
+    if (tensor) {
+      return *tensor;
+    } else if (is_complex) {
+      return mlx::core::array(complex_scalar, dtype);
+    } else {
+      return mlx::core::array(scalar, dtype);
+    }
+  }
+};
+
+#define OPERAND_PARAM(ARGN, VAR)                                               \
+  Operand VAR;                                                                 \
+  if (enif_is_number(env, argv[ARGN]) || enif_is_tuple(env, argv[ARGN])) {    \
+    SCALAR_PARAM(ARGN, VAR##_scalar, VAR##_is_complex);                        \
+    VAR.scalar = VAR##_scalar;                                                 \
+    VAR.complex_scalar = complex_##VAR##_scalar;                               \
+    VAR.is_complex = VAR##_is_complex;                                         \
+    VAR.is_float = !VAR##_is_complex && enif_is_number(env, argv[ARGN]) &&     \
+                   enif_get_double(env, argv[ARGN], &VAR##_scalar);            \
+  } else {                                                                     \
+    TENSOR_PARAM(ARGN, VAR##_tensor);                                          \
+    VAR.tensor = *VAR##_tensor;                                                \
+  }
+
+// Binary op NIFs take (a, b, device) or (a, b, compute_type, out_type,
+// device). The typed form casts both operands to compute_type, relies on
+// MLX broadcasting and casts the result to out_type, all in a single call.
+#define BINARY_OP_IMPL(OP, FN)                                                 \
+  NIF(OP) {                                                                    \
+    OPERAND_PARAM(0, a);                                                       \
+    OPERAND_PARAM(1, b);                                                       \
+                                                                               \
+    if (argc == 5) {                                                           \
+      TYPE_PARAM(2, compute_type);                                             \
+      TYPE_PARAM(3, out_type);                                                 \
+      DEVICE_PARAM(4, device);                                                 \
+                                                                               \
+      try {                                                                    \
+        auto compute = device_dtype(compute_type, device);                     \
+        auto lhs = maybe_astype(a.to_array(compute), compute, device);         \
+        auto rhs = maybe_astype(b.to_array(compute), compute, device);         \
+        auto result = FN(lhs, rhs, device);                                    \
+        TENSOR(maybe_astype(result, device_dtype(out_type, device), device));  \
+      }                                                                        \
+      CATCH()                                                                  \
+    } else {                                                                   \
+      DEVICE_PARAM(2, device);                                                 \
+                                                                               \
+      if (!a.tensor && !b.tensor)                                              \
+        return nx::nif::error(env, "At least one operand must be a tensor");   \
+                                                                               \
+      auto dtype = a.tensor ? a.tensor->dtype() : b.tensor->dtype();           \
+      dtype = a.promote(b.promote(dtype));                                     \
+      TENSOR(FN(a.to_array(dtype), b.to_array(dtype), device));                \
+    }                                                                          \
+  }
+
+#define BINARY_OP(OP) BINARY_OP2(OP, OP)
+
+#define BINARY_OP2(OP, NATIVE_OP) BINARY_OP_IMPL(OP, mlx::core::NATIVE_OP)
+
+/* KV cache */
+
+// Keys and values of each layer live in buffers preallocated at max_len
+// along axis -2 and owned by the cache alone. Appending replaces a buffer
+// with a slice_update of itself; with no other reference to the old
+// array MLX donates it to the update, so each token is written in place
+// instead of copying the whole cache. Views share the buffer, so the
+// cache keeps the views it hands out and deallocates those of a layer
+// before appending to it. Otherwise views waiting for the garbage
+// collector would force a copy of the whole buffer on every append.
+//
+// In ring mode writes wrap around once max_len entries are stored, and
+// the views cover the whole buffer in storage order.
+struct KVCache {
+  KVCache(std::vector<mlx::core::array> keys,
+          std::vector<mlx::core::array> values, int max_len, bool ring,
+          mlx::core::Device device)
+      : keys(std::move(keys)), values(std::move(values)),
+        lengths(this->keys.size(), 0), offsets(this->keys.size(), 0),
+        views(this->keys.size()), max_len(max_len), ring(ring),
+        device(device) {}
+
+  ~KVCache() {
+    for (auto &layer : views) {
+      for (auto view : layer) {
+        enif_release_resource(view);
+      }
+    }
+  }
+
+  std::mutex mutex;
+  std::vector<mlx::core::array> keys;
+  std::vector<mlx::core::array> values;
+  // Tensor resources handed out by kv_cache_keys and kv_cache_values
+  std::vector<std::vector<void *>> views;
+  std::vector<int> lengths;
+  std::vector<int> offsets;
+  const int max_len;
+  const bool ring;
+  const mlx::core::Device device;
+};
+
+static ErlNifResourceType *KV_CACHE_TYPE;
+
+static void free_kv_cache(ErlNifEnv *env, void *obj) {
+  static_cast<KVCache *>(obj)->~KVCache();
+}
+
+#define KV_CACHE_PARAM(ARGN, VAR)                                              \
+  KVCache *VAR;                                                                \
+  if (!enif_get_resource(env, argv[ARGN], KV_CACHE_TYPE, (void **)&VAR)) {     \
+    return nx::nif::error(env, "Unable to get KV cache param in NIF");         \
+  }
+
+#define KV_CACHE_LAYER_PARAM(ARGN, CACHE, VAR)                                 \
+  PARAM(ARGN, int, VAR);                                                       \
+  if (VAR < 0 || VAR >= static_cast<int>(CACHE->keys.size())) {               \
+    return nx::nif::error(env, "KV cache layer out of range");                 \
+  }
+
+// Rows [start, stop) of axis -2
+static mlx::core::array slice_steps(const mlx::core::array &a, int start,
+                                    int stop,
+                                    const mlx::core::Device &device) {
+  std::vector<int> starts(a.ndim(), 0);
+  std::vector<int> stops(a.shape().begin(), a.shape().end());
+  starts[a.ndim() - 2] = start;
+  stops[a.ndim() - 2] = stop;
+  return mlx::core::slice(a, starts, stops, device);
+}
+
+// Whether an update has the shape of the buffer on every axis but the
+// steps axis, as slice_update would otherwise broadcast it
+static bool same_step_shape(const mlx::core::array &update,
+                            const mlx::core::array &buffer) {
+  int ndim = buffer.ndim();
+  if (static_cast<int>(update.ndim()) != ndim) {
+    return false;
+  }
+  for (int axis = 0; axis < ndim; axis++) {
+    if (axis != ndim - 2 && update.shape(axis) != buffer.shape(axis)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static mlx::core::array write_steps(const mlx::core::array &buffer,
+                                    const mlx::core::array &update, int offset,
+                                    const mlx::core::Device &device) {
+  std::vector<int> starts(buffer.ndim(), 0);
+  std::vector<int> stops(buffer.shape().begin(), buffer.shape().end());
+  starts[buffer.ndim() - 2] = offset;
+  stops[buffer.ndim() - 2] = offset + update.shape(-2);
+  return mlx::core::slice_update(
+      buffer, maybe_astype(update, buffer.dtype(), device), starts, stops,
+      device);
+}
+
+// Deallocates the views of a layer still alive, as the deallocate NIF
+// does, so the cache holds the only reference to its buffers
+static void release_views(ErlNifEnv *env, KVCache *cache, int layer) {
+  for (auto view : cache->views[layer]) {
+    TensorP t(env, enif_make_resource(env, view));
+    if (t.is_valid()) {
+      t.deallocate();
+    }
+    enif_release_resource(view);
+  }
+  cache->views[layer].clear();
+}
+
+static ERL_NIF_TERM make_view(ErlNifEnv *env, KVCache *cache, int layer,
+                              mlx::core::array view) {
+  ERL_NIF_TERM term = create_tensor_resource(env, std::move(view));
+  void *ptr;
+  if (enif_get_resource(env, term, TENSOR_TYPE, &ptr)) {
+    enif_keep_resource(ptr);
+    cache->views[layer].push_back(ptr);
+  }
+  return nx::nif::ok(env, term);
+}
+
+NIF(kv_cache_new) {
+  PARAM(0, int, layers);
+  SHAPE_PARAM(1, shape);
+  TYPE_PARAM(2, type);
+  PARAM(3, bool, ring);
+  DEVICE_PARAM(4, device);
+
+  if (layers < 1 || shape.size() < 2 || shape[shape.size() - 2] < 1) {
+    return nx::nif::error(env, "KV cache needs at least one layer and a "
+                               "shape of rank 2 or more with max_len > 0");
+  }
+
+  try {
+    auto dtype = device_dtype(type, device);
+    std::vector<mlx::core::array> keys, values;
+    for (int layer = 0; layer < layers; layer++) {
+      keys.push_back(mlx::core::zeros(shape, dtype, device));
+      values.push_back(mlx::core::zeros(shape, dtype, device));
+    }
+
+    void *ptr = enif_alloc_resource(KV_CACHE_TYPE, sizeof(KVCache));
+    if (ptr == NULL) {
+      return enif_make_badarg(env);
+    }
+    new (ptr) KVCache(std::move(keys), std::move(values),
+                      shape[shape.size() - 2], ring, device);
+
+    ERL_NIF_TERM ret = enif_make_resource(env, ptr);
+    enif_release_resource(ptr);
+    return nx::nif::ok(env, ret);
+  }
+  CATCH()
+}
+
+NIF(kv_cache_append) {
+  KV_CACHE_PARAM(0, cache);
+  KV_CACHE_LAYER_PARAM(1, cache, layer);
+  TENSOR_PARAM(2, keys);
+  TENSOR_PARAM(3, values);
+
+  try {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    const auto &device = cache->device;
+    int steps = keys->ndim() < 2 ? 0 : keys->shape(-2);
+    int offset = cache->offsets[layer];
+
+    if (!same_step_shape(*keys, cache->keys[layer]) ||
+        !same_step_shape(*values, cache->values[layer]) ||
+        values->shape(-2) != steps) {
+      return nx::nif::error(
+          env, "KV cache keys and values must match the cache shape on every "
+               "axis but the steps axis and have the same number of steps");
+    }
+
+    if (!cache->ring && offset + steps > cache->max_len) {
+      return nx::nif::error(env, "KV cache is full");
+    }
+
+    auto k = *keys;
+    auto v = *values;
+
+    // Only the last max_len steps survive a ring write
+    if (steps > cache->max_len) {
+      k = slice_steps(k, steps - cache->max_len, steps, device);
+      v = slice_steps(v, steps - cache->max_len, steps, device);
+      offset = (offset + steps - cache->max_len) % cache->max_len;
+      steps = cache->max_len;
+    }
+
+    // Both writes are built before the cache is touched, so a failure
+    // leaves keys, values and offset as they were
+    int head = std::min(steps, cache->max_len - offset);
+    auto new_keys = write_steps(
+        cache->keys[layer], slice_steps(k, 0, head, device), offset, device);
+    auto new_values = write_steps(
+        cache->values[layer], slice_steps(v, 0, head, device), offset, device);
+
+    if (head < steps) {
+      new_keys = write_steps(new_keys, slice_steps(k, head, steps, device), 0,
+                             device);
+      new_values = write_steps(new_values, slice_steps(v, head, steps, device),
+                               0, device);
+    }
+
+    release_views(env, cache, layer);
+    cache->keys[layer] = std::move(new_keys);
+    cache->values[layer] = std::move(new_values);
+    cache->offsets[layer] =
+        cache->ring ? (offset + steps) % cache->max_len : offset + steps;
+    cache->lengths[layer] =
+        std::min(cache->lengths[layer] + steps, cache->max_len);
+
+    return nx::nif::ok(env);
+  }
+  CATCH()
+}
+
+NIF(kv_cache_keys) {
+  KV_CACHE_PARAM(0, cache);
+  KV_CACHE_LAYER_PARAM(1, cache, layer);
+  DEVICE_PARAM(2, device);
+
+  try {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    return make_view(
+        env, cache, layer,
+        slice_steps(cache->keys[layer], 0, cache->lengths[layer], device));
+  }
+  CATCH()
+}
+
+NIF(kv_cache_values) {
+  KV_CACHE_PARAM(0, cache);
+  KV_CACHE_LAYER_PARAM(1, cache, layer);
+  DEVICE_PARAM(2, device);
+
+  try {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    return make_view(
+        env, cache, layer,
+        slice_steps(cache->values[layer], 0, cache->lengths[layer], device));
+  }
+  CATCH()
+}
+
+NIF(kv_cache_length) {
+  KV_CACHE_PARAM(0, cache);
+  KV_CACHE_LAYER_PARAM(1, cache, layer);
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  return nx::nif::ok(env, nx::nif::make(env, cache->lengths[layer]));
+}
+
+// Buffers are kept, so a reset cache is refilled without reallocating
+NIF(kv_cache_reset) {
+  KV_CACHE_PARAM(0, cache);
+
+  std::lock_guard<std::mutex> lock(cache->mutex);
+  std::fill(cache->lengths.begin(), cache->lengths.end(), 0);
+  std::fill(cache->offsets.begin(), cache->offsets.end(), 0);
+  return nx::nif::ok(env);
+}
+
+/* Data loader */
+
+// Uploads batches on a worker thread, so copying and casting them
+// overlaps with the consumer's computation. loader_push queues a binary
+// without copying it, and the worker sends each evaluated array to the
+// process that created the loader as {tag, {:ok, ref}} or
+// {tag, {:error, message}}, in push order.
+//
+// The worker is detached and shares the state with the resource, so
+// neither loader_close nor the resource destructor waits for an upload
+// to finish. Whichever of the two lets go last frees the state.
+struct LoaderItem {
+  ErlNifEnv *env;
+  ERL_NIF_TERM binary;
+};
+
+struct LoaderState {
+  LoaderState(std::vector<int> shape, mlx::core::Dtype in_type,
+              mlx::core::Dtype out_type, mlx::core::Device device,
+              ErlNifPid owner, ErlNifEnv *tag_env, ERL_NIF_TERM tag)
+      : shape(std::move(shape)), in_type(in_type), out_type(out_type),
+        device(device), owner(owner), tag_env(tag_env), tag(tag) {}
+
+  ~LoaderState() {
+    for (auto &item : pending) {
+      enif_free_env(item.env);
+    }
+    enif_free_env(tag_env);
+  }
+
+  // Once this returns the worker sends no more messages, as it only
+  // sends while holding the mutex on an open loader
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+      for (auto &item : pending) {
+        enif_free_env(item.env);
+      }
+      pending.clear();
+    }
+    ready.notify_one();
+  }
+
+  const std::vector<int> shape;
+  const mlx::core::Dtype in_type;
+  const mlx::core::Dtype out_type;
+  const mlx::core::Device device;
+  const ErlNifPid owner;
+  ErlNifEnv *const tag_env;
+  const ERL_NIF_TERM tag;
+
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<LoaderItem> pending;
+  bool closed = false;
+};
+
+struct Loader {
+  std::shared_ptr<LoaderState> state;
+};
+
+static ErlNifResourceType *LOADER_TYPE;
+
+static void free_loader(ErlNifEnv *env, void *obj) {
+  auto loader = static_cast<Loader *>(obj);
+  loader->state->close();
+  loader->~Loader();
+}
+
+#define LOADER_PARAM(ARGN, VAR)                                                \
+  Loader *VAR##_resource;                                                      \
+  if (!enif_get_resource(env, argv[ARGN], LOADER_TYPE,                         \
+                         (void **)&VAR##_resource)) {                          \
+    return nx::nif::error(env, "Unable to get loader param in NIF");           \
+  }                                                                            \
+  LoaderState *VAR = VAR##_resource->state.get();
+
+static mlx::core::array upload(LoaderState *loader, const ErlNifBinary &blob) {
+  size_t byte_size = loader->in_type.size() * elem_count(loader->shape);
+  if (blob.size < byte_size) {
+    throw std::invalid_argument(
+        "Binary size is too small for the requested shape");
+  }
+
+  allocator::Buffer buffer = allocator::malloc(byte_size);
+  std::memcpy(buffer.raw_ptr(), blob.data, byte_size);
+  auto deleter = [](allocator::Buffer buf) { allocator::free(buf); };
+
+  // Types the device cannot hold are converted on the CPU, as in from_blob
+  auto cast_device =
+      device_dtype(loader->in_type, loader->device) == loader->in_type
+          ? loader->device
+          : mlx::core::Device(mlx::core::Device::DeviceType::cpu, 0);
+
+  auto result = maybe_astype(
+      mlx::core::array(buffer, loader->shape, loader->in_type, deleter),
+      device_dtype(loader->out_type, loader->device), cast_device);
+  mlx::core::eval(result);
+  return result;
+}
+
+static void run_loader(std::shared_ptr<LoaderState> loader) {
+  while (true) {
+    LoaderItem item;
+    {
+      std::unique_lock<std::mutex> lock(loader->mutex);
+      loader->ready.wait(lock, [&loader] {
+        return loader->closed || !loader->pending.empty();
+      });
+      if (loader->closed) {
+        return;
+      }
+      item = loader->pending.front();
+      loader->pending.pop_front();
+    }
+
+    ErlNifEnv *msg_env = enif_alloc_env();
+    ERL_NIF_TERM result;
+
+    try {
+      ErlNifBinary blob;
+      enif_inspect_binary(item.env, item.binary, &blob);
+      auto batch = upload(loader.get(), blob);
+      result = nx::nif::ok(msg_env, create_tensor_resource(msg_env, batch));
+    } catch (const std::exception &e) {
+      result = nx::nif::error(msg_env, e.what());
+    } catch (...) {
+      result = nx::nif::error(msg_env, "Unknown error uploading batch");
+    }
+    enif_free_env(item.env);
+
+    {
+      std::lock_guard<std::mutex> lock(loader->mutex);
+      if (!loader->closed) {
+        ErlNifPid owner = loader->owner;
+        ERL_NIF_TERM msg = enif_make_tuple2(
+            msg_env, enif_make_copy(msg_env, loader->tag), result);
+        enif_send(NULL, &owner, msg_env, msg);
+      }
+    }
+    enif_free_env(msg_env);
+  }
+}
+
+NIF(loader_new) {
+  SHAPE_PARAM(0, shape);
+  TYPE_PARAM(1, in_type);
+  TYPE_PARAM(2, out_type);
+  DEVICE_PARAM(4, device);
+
+  ErlNifPid owner;
+  enif_self(env, &owner);
+
+  ErlNifEnv *tag_env = enif_alloc_env();
+  ERL_NIF_TERM tag = enif_make_copy(tag_env, argv[3]);
+  auto state = std::make_shared<LoaderState>(shape, in_type, out_type, device,
+                                             owner, tag_env, tag);
+
+  try {
+    std::thread(run_loader, state).detach();
+  } catch (const std::exception &e) {
+    return nx::nif::error(env, e.what());
+  }
+
+  void *ptr = enif_alloc_resource(LOADER_TYPE, sizeof(Loader));
+  if (ptr == NULL) {
+    state->close();
+    return enif_make_badarg(env);
+  }
+  new (ptr) Loader{state};
+
+  ERL_NIF_TERM ret = enif_make_resource(env, ptr);
+  enif_release_resource(ptr);
+  return nx::nif::ok(env, ret);
+}
+
+NIF(loader_push) {
+  LOADER_PARAM(0, loader);
+
+  if (!enif_is_binary(env, argv[1])) {
+    return nx::nif::error(env, "Unable to get binary param.");
+  }
+
+  // Copying the term into its own env keeps the binary alive without
+  // copying its bytes
+  LoaderItem item;
+  item.env = enif_alloc_env();
+  item.binary = enif_make_copy(item.env, argv[1]);
+
+  {
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    if (loader->closed) {
+      enif_free_env(item.env);
+      return nx::nif::error(env, "Loader is closed");
+    }
+    loader->pending.push_back(item);
+  }
+  loader->ready.notify_one();
+
+  return nx::nif::ok(env);
+}
+
+// Drops the queued binaries and stops the worker without waiting for
+// the batch it is uploading, whose result is discarded
+NIF(loader_close) {
+  LOADER_PARAM(0, loader);
+  loader->close();
+  return nx::nif::ok(env);
+}
+
+/* Executor */
+
+// Evaluates arrays on a fixed pool of native threads instead of on the
+// calling scheduler. Submissions wait in an interactive and a batch
+// queue, interactive first, and at most max_concurrency of them run at
+// once. Each caller receives {tag, :ok | {:error, message}, queue_us,
+// run_us} when its arrays are ready.
+//
+// Threads are started as the limit grows and kept for the lifetime of
+// the VM, so lowering the limit parks them rather than stopping them.
+struct ExecutorJob {
+  std::vector<mlx::core::array> arrays;
+  ErlNifPid owner;
+  ErlNifEnv *env;
+  ERL_NIF_TERM tag;
+  std::chrono::steady_clock::time_point queued_at;
+};
+
+struct Executor {
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<ExecutorJob> interactive;
+  std::deque<ExecutorJob> batch;
+  int max_concurrency = 2;
+  int max_queue = 256;
+  int running = 0;
+  int threads = 0;
+  uint64_t completed = 0;
+
+  int depth() const {
+    return static_cast<int>(interactive.size() + batch.size());
+  }
+
+  bool runnable() const {
+    return running < max_concurrency &&
+           !(interactive.empty() && batch.empty());
+  }
+};
+
+// Never destroyed, as the detached threads may outlive static cleanup
+static Executor *executor = new Executor();
+
+static int64_t elapsed_us(std::chrono::steady_clock::time_point from,
+                          std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(to - from)
+      .count();
+}
+
+static void run_executor() {
+  while (true) {
+    ExecutorJob job;
+    {
+      std::unique_lock<std::mutex> lock(executor->mutex);
+      executor->ready.wait(lock, [] { return executor->runnable(); });
+
+      auto &queue = executor->interactive.empty() ? executor->batch
+                                                  : executor->interactive;
+      job = std::move(queue.front());
+      queue.pop_front();
+      executor->running++;
+    }
+
+    auto started_at = std::chrono::steady_clock::now();
+    ErlNifEnv *msg_env = enif_alloc_env();
+    ERL_NIF_TERM result;
+
+    try {
+      mlx::core::eval(job.arrays);
+      result = nx::nif::ok(msg_env);
+    } catch (const std::exception &e) {
+      result = nx::nif::error(msg_env, e.what());
+    } catch (...) {
+      result = nx::nif::error(msg_env, "Unknown error evaluating arrays");
+    }
+
+    // Drop the arrays before replying, so the caller can deallocate them
+    job.arrays.clear();
+    auto finished_at = std::chrono::steady_clock::now();
+
+    ERL_NIF_TERM msg = enif_make_tuple4(
+        msg_env, enif_make_copy(msg_env, job.tag), result,
+        nx::nif::make(msg_env, elapsed_us(job.queued_at, started_at)),
+        nx::nif::make(msg_env, elapsed_us(started_at, finished_at)));
+    enif_send(NULL, &job.owner, msg_env, msg);
+    enif_free_env(msg_env);
+    enif_free_env(job.env);
+
+    {
+      std::lock_guard<std::mutex> lock(executor->mutex);
+      executor->running--;
+      executor->completed++;
+    }
+    executor->ready.notify_one();
+  }
+}
+
+// Starts threads up to the limit. Called with the mutex held.
+static void grow_executor() {
+  while (executor->threads < executor->max_concurrency) {
+    std::thread(run_executor).detach();
+    executor->threads++;
+  }
+}
+
+NIF(executor_submit) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, arrays);
+  PARAM(1, bool, interactive);
+
+  ExecutorJob job;
+  job.arrays = std::move(arrays);
+  enif_self(env, &job.owner);
+  job.queued_at = std::chrono::steady_clock::now();
+
+  int depth;
+  {
+    std::lock_guard<std::mutex> lock(executor->mutex);
+    depth = executor->depth();
+
+    // A full queue is reported to the caller rather than waited on
+    if (depth >= executor->max_queue) {
+      return nx::nif::ok(
+          env, enif_make_tuple2(env, nx::nif::atom(env, "overloaded"),
+                                nx::nif::make(env, depth)));
+    }
+
+    try {
+      grow_executor();
+    } catch (const std::exception &e) {
+      return nx::nif::error(env, e.what());
+    }
+
+    job.env = enif_alloc_env();
+    job.tag = enif_make_copy(job.env, argv[2]);
+    (interactive ? executor->interactive : executor->batch)
+        .push_back(std::move(job));
+    depth++;
+  }
+  executor->ready.notify_one();
+
+  return nx::nif::ok(env, enif_make_tuple2(env, nx::nif::atom(env, "queued"),
+                                           nx::nif::make(env, depth)));
+}
 
-#define REDUCTION_AXIS_OP2(OP, NATIVE_OP)                                      \
-  NIF(OP) {                                                                    \
-    TENSOR_PARAM(0, tensor);                                                   \
-    if (argc == 3) {                                                           \
-      PARAM(1, bool, keep_dims);                                               \
-      DEVICE_PARAM(2, device);                                                 \
-      TENSOR(mlx::core::NATIVE_OP(*tensor, keep_dims, device));                \
-    } else {                                                                   \
-      PARAM(1, int, axis);                                                     \
-      PARAM(2, bool, keep_dims);                                               \
-      DEVICE_PARAM(3, device);                                                 \
-      TENSOR(mlx::core::NATIVE_OP(*tensor, axis, keep_dims, device));          \
-    }                                                                          \
+NIF(executor_configure) {
+  PARAM(0, int, max_concurrency);
+  PARAM(1, int, max_queue);
+
+  if (max_concurrency < 1 || max_queue < 1) {
+    return nx::nif::error(env, "Executor limits must be positive");
   }
 
-#define REDUCTION_AXIS_REVERSIBLE_OP(OP) REDUCTION_AXIS_REVERSIBLE_OP2(OP, OP)
+  {
+    std::lock_guard<std::mutex> lock(executor->mutex);
+    executor->max_concurrency = max_concurrency;
+    executor->max_queue = max_queue;
 
-#define REDUCTION_AXIS_REVERSIBLE_OP2(OP, NATIVE_OP)                           \
-  NIF(OP) {                                                                    \
-    TENSOR_PARAM(0, tensor);                                                   \
-    PARAM(1, int, axis);                                                       \
-    PARAM(2, bool, keep_dims);                                                 \
-    DEVICE_PARAM(3, device);                                                   \
-                                                                               \
-    TENSOR(mlx::core::NATIVE_OP(*tensor, axis, keep_dims, device));            \
+    try {
+      grow_executor();
+    } catch (const std::exception &e) {
+      return nx::nif::error(env, e.what());
+    }
   }
+  executor->ready.notify_all();
 
-REDUCTION_AXES_OP(all)
-REDUCTION_AXES_OP(any)
-REDUCTION_AXES_OP(sum)
-REDUCTION_AXES_OP2(product, prod)
-REDUCTION_AXIS_OP(argmax)
-REDUCTION_AXIS_OP(argmin)
+  return nx::nif::ok(env);
+}
 
-NIF(cumulative_sum) {
-  TENSOR_PARAM(0, tensor);
-  PARAM(1, int, axis);
-  PARAM(2, bool, reverse);
-  PARAM(3, bool, inclusive);
-  DEVICE_PARAM(4, device);
-  TENSOR(mlx::core::cumsum(*tensor, axis, reverse, inclusive, device));
+NIF(executor_stats) {
+  std::lock_guard<std::mutex> lock(executor->mutex);
+
+  ERL_NIF_TERM keys[] = {nx::nif::atom(env, "interactive"),
+                         nx::nif::atom(env, "batch"),
+                         nx::nif::atom(env, "running"),
+                         nx::nif::atom(env, "completed"),
+                         nx::nif::atom(env, "max_concurrency"),
+                         nx::nif::atom(env, "max_queue")};
+  ERL_NIF_TERM values[] = {
+      nx::nif::make(env, static_cast<int>(executor->interactive.size())),
+      nx::nif::make(env, static_cast<int>(executor->batch.size())),
+      nx::nif::make(env, executor->running),
+      nx::nif::make(env, static_cast<int64_t>(executor->completed)),
+      nx::nif::make(env, executor->max_concurrency),
+      nx::nif::make(env, executor->max_queue)};
+
+  ERL_NIF_TERM map;
+  enif_make_map_from_arrays(env, keys, values, 6, &map);
+  return nx::nif::ok(env, map);
 }
 
-NIF(cumulative_product) {
-  TENSOR_PARAM(0, tensor);
-  PARAM(1, int, axis);
-  PARAM(2, bool, reverse);
-  PARAM(3, bool, inclusive);
-  DEVICE_PARAM(4, device);
-  TENSOR(mlx::core::cumprod(*tensor, axis, reverse, inclusive, device));
+/* Optimizers */
+
+// Per-tensor update kernels. They are compiled shapeless, so each dtype
+// is traced once and every parameter's update then runs as one fused
+// kernel. Hyperparameters are passed as scalars rather than captured,
+// which keeps the compiled graph valid across steps and schedules.
+
+// p, g, trace, lr, momentum, weight_decay
+static std::vector<mlx::core::array>
+sgd_trace(const std::vector<mlx::core::array> &in) {
+  auto g = in[1] + in[5] * in[0];
+  return {g, in[4] * in[2] + g};
 }
 
-NIF(cumulative_max) {
-  TENSOR_PARAM(0, tensor);
-  PARAM(1, int, axis);
-  PARAM(2, bool, reverse);
-  PARAM(3, bool, inclusive);
-  DEVICE_PARAM(4, device);
-  TENSOR(mlx::core::cummax(*tensor, axis, reverse, inclusive, device));
+static std::vector<mlx::core::array>
+sgd_kernel(const std::vector<mlx::core::array> &in) {
+  auto gt = sgd_trace(in);
+  return {mlx::core::astype(in[0] - in[3] * gt[1], in[0].dtype()),
+          mlx::core::astype(gt[1], in[2].dtype())};
 }
 
-NIF(cumulative_min) {
-  TENSOR_PARAM(0, tensor);
-  PARAM(1, int, axis);
-  PARAM(2, bool, reverse);
-  PARAM(3, bool, inclusive);
-  DEVICE_PARAM(4, device);
-  TENSOR(mlx::core::cummin(*tensor, axis, reverse, inclusive, device));
+static std::vector<mlx::core::array>
+sgd_nesterov_kernel(const std::vector<mlx::core::array> &in) {
+  auto gt = sgd_trace(in);
+  auto update = gt[0] + in[4] * gt[1];
+  return {mlx::core::astype(in[0] - in[3] * update, in[0].dtype()),
+          mlx::core::astype(gt[1], in[2].dtype())};
 }
 
-/* Unary Ops */
+// p, g, mu, nu, lr, b1, b2, eps, l2_decay, decoupled_decay, c1, c2 where
+// c1 and c2 are the bias corrections 1 - b1^t and 1 - b2^t
+static std::vector<mlx::core::array>
+adam_kernel(const std::vector<mlx::core::array> &in) {
+  const auto &p = in[0];
+  auto one = mlx::core::array(1.0f);
+  auto g = in[1] + in[8] * p;
+  auto mu = in[5] * in[2] + (one - in[5]) * g;
+  auto nu = in[6] * in[3] + (one - in[6]) * mlx::core::square(g);
+  auto update = (mu / in[10]) / (mlx::core::sqrt(nu / in[11]) + in[7]);
+  auto next = p - in[4] * (update + in[9] * p);
+
+  return {mlx::core::astype(next, p.dtype()),
+          mlx::core::astype(mu, in[2].dtype()),
+          mlx::core::astype(nu, in[3].dtype())};
+}
 
-#define UNARY_OP(OP) UNARY_OP2(OP, OP)
+using Kernel = std::function<std::vector<mlx::core::array>(
+    const std::vector<mlx::core::array> &)>;
+
+// Compiled functions run on the default stream and the compile cache is
+// not thread safe, so calls are serialized and pinned to the device.
+// They only build the lazy graph, the work happens at eval.
+static std::mutex optim_mutex;
+
+static std::vector<mlx::core::array>
+apply_update(const Kernel &kernel, size_t outputs,
+             const std::vector<std::vector<mlx::core::array>> &tensors,
+             const std::vector<double> &scalars,
+             const mlx::core::Device &device) {
+  size_t count = tensors[0].size();
+  for (const auto &list : tensors) {
+    if (list.size() != count) {
+      throw std::invalid_argument(
+          "optimizer params, grads and state must have the same length");
+    }
+  }
 
-#define UNARY_OP2(OP, NATIVE_OP)                                               \
-  NIF(OP) {                                                                    \
-    TENSOR_PARAM(0, tensor);                                                   \
-    DEVICE_PARAM(1, device);                                                   \
-                                                                               \
-    TENSOR(mlx::core::NATIVE_OP(*tensor, device));                             \
+  std::vector<mlx::core::array> scalar_arrays;
+  for (auto scalar : scalars) {
+    scalar_arrays.push_back(mlx::core::array(static_cast<float>(scalar)));
   }
 
-/* Binary Ops */
+  std::lock_guard<std::mutex> lock(optim_mutex);
+  mlx::core::StreamContext stream(device);
 
-#define BINARY_OP(OP) BINARY_OP2(OP, OP)
+  // Outputs are grouped by kind: all params, then each state in turn
+  std::vector<std::vector<mlx::core::array>> groups(outputs);
+  for (size_t i = 0; i < count; i++) {
+    std::vector<mlx::core::array> inputs;
+    for (const auto &list : tensors) {
+      inputs.push_back(list[i]);
+    }
+    inputs.insert(inputs.end(), scalar_arrays.begin(), scalar_arrays.end());
 
-#define BINARY_OP2(OP, NATIVE_OP)                                              \
-  NIF(OP) {                                                                    \
-    TENSOR_PARAM(0, a);                                                        \
-    TENSOR_PARAM(1, b);                                                        \
-    DEVICE_PARAM(2, device);                                                   \
-                                                                               \
-    TENSOR(mlx::core::NATIVE_OP(*a, *b, device));                              \
+    auto results = kernel(inputs);
+    for (size_t k = 0; k < outputs; k++) {
+      groups[k].push_back(results[k]);
+    }
+  }
+
+  std::vector<mlx::core::array> flat;
+  for (auto &group : groups) {
+    flat.insert(flat.end(), group.begin(), group.end());
+  }
+  return flat;
+}
+
+// Returns the updated params followed by the updated traces
+NIF(optim_sgd) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, params);
+  LIST_PARAM(1, std::vector<mlx::core::array>, grads);
+  LIST_PARAM(2, std::vector<mlx::core::array>, traces);
+  PARAM(3, double, learning_rate);
+  PARAM(4, double, momentum);
+  PARAM(5, double, weight_decay);
+  PARAM(6, bool, nesterov);
+  DEVICE_PARAM(7, device);
+
+  try {
+    static auto sgd = mlx::core::compile(sgd_kernel, true);
+    static auto sgd_nesterov = mlx::core::compile(sgd_nesterov_kernel, true);
+
+    return tensor_list(
+        env, apply_update(nesterov ? sgd_nesterov : sgd, 2,
+                          {params, grads, traces},
+                          {learning_rate, momentum, weight_decay}, device));
+  }
+  CATCH()
+}
+
+// Adam with L2 decay added to the gradients, or AdamW with decoupled
+// decay. Returns the updated params, then the first and second moments.
+NIF(optim_adam) {
+  LIST_PARAM(0, std::vector<mlx::core::array>, params);
+  LIST_PARAM(1, std::vector<mlx::core::array>, grads);
+  LIST_PARAM(2, std::vector<mlx::core::array>, mus);
+  LIST_PARAM(3, std::vector<mlx::core::array>, nus);
+  PARAM(4, double, learning_rate);
+  PARAM(5, double, b1);
+  PARAM(6, double, b2);
+  PARAM(7, double, eps);
+  PARAM(8, double, l2_decay);
+  PARAM(9, double, decoupled_decay);
+  PARAM(10, double, c1);
+  PARAM(11, double, c2);
+  DEVICE_PARAM(12, device);
+
+  try {
+    static auto adam = mlx::core::compile(adam_kernel, true);
+
+    return tensor_list(env,
+                       apply_update(adam, 3, {params, grads, mus, nus},
+                                    {learning_rate, b1, b2, eps, l2_decay,
+                                     decoupled_decay, c1, c2},
+                                    device));
   }
+  CATCH()
+}
 
 static void free_tensor(ErlNifEnv *env, void *obj) {
   mlx::core::array *arr = static_cast<mlx::core::array *>(obj);
@@ -685,6 +2463,18 @@ static int open_resource_type(ErlNifEnv *env) {
   if (TENSOR_TYPE == NULL) {
     return -1;
   }
+
+  KV_CACHE_TYPE = enif_open_resource_type(env, NULL, "EMLXKVCache",
+                                          free_kv_cache, flags, NULL);
+  if (KV_CACHE_TYPE == NULL) {
+    return -1;
+  }
+
+  LOADER_TYPE = enif_open_resource_type(env, NULL, "EMLXLoader", free_loader,
+                                        flags, NULL);
+  if (LOADER_TYPE == NULL) {
+    return -1;
+  }
   return 0;
 }
 
@@ -761,16 +2551,15 @@ BINARY_OP(greater_equal)
 BINARY_OP(less_equal)
 BINARY_OP(logical_and)
 BINARY_OP(logical_or)
-NIF(logical_xor) {
-  TENSOR_PARAM(0, a);
-  TENSOR_PARAM(1, b);
-  DEVICE_PARAM(2, device);
-
-  auto t1 = mlx::core::logical_or(*a, *b, device);
+mlx::core::array logical_xor_op(const mlx::core::array &a,
+                                const mlx::core::array &b,
+                                const mlx::core::Device &device) {
+  auto t1 = mlx::core::logical_or(a, b, device);
   auto t2 =
-      mlx::core::logical_not(mlx::core::logical_and(*a, *b, device), device);
-  TENSOR(mlx::core::logical_and(t1, t2, device));
+      mlx::core::logical_not(mlx::core::logical_and(a, b, device), device);
+  return mlx::core::logical_and(t1, t2, device);
 }
+BINARY_OP_IMPL(logical_xor, logical_xor_op)
 NIF(allclose) {
   TENSOR_PARAM(0, a);
   TENSOR_PARAM(1, b);
@@ -833,11 +2622,44 @@ NIF(squeeze) {
   TENSOR(mlx::core::squeeze(*t, axes, device));
 }
 
+// The spectrum of a real signal is Hermitian, X[n - k] = conj(X[k]), so
+// only the first n / 2 + 1 bins are computed and the rest are mirrored.
+// This halves the transform compared to promoting the input to complex64.
+static mlx::core::array real_fft(const mlx::core::array &t, int n, int axis,
+                                 const mlx::core::Device &device) {
+  auto half = mlx::core::fft::rfft(maybe_astype(t, mlx::core::float32, device),
+                                   n, axis, device);
+  int tail = n - n / 2 - 1;
+  if (tail == 0) {
+    return half;
+  }
+
+  axis = axis < 0 ? axis + half.ndim() : axis;
+  std::vector<int> starts(half.ndim(), 0);
+  std::vector<int> stops(half.shape().begin(), half.shape().end());
+  starts[axis] = 1;
+  stops[axis] = 1 + tail;
+
+  auto mirrored = mlx::core::conjugate(
+      reverse_axis(mlx::core::slice(half, starts, stops, device), axis,
+                   device),
+      device);
+  return mlx::core::concatenate({half, mirrored}, axis, device);
+}
+
+inline bool is_complex(const mlx::core::array &t) {
+  return mlx::core::issubdtype(t.dtype(), mlx::core::complexfloating);
+}
+
 NIF(emlx_fft) {
   TENSOR_PARAM(0, t);
   PARAM(1, int, n);
   PARAM(2, int, axis);
   DEVICE_PARAM(3, device);
+
+  if (!is_complex(*t)) {
+    TENSOR(real_fft(*t, n, axis, device));
+  }
   TENSOR(mlx::core::fft::fft(*t, n, axis, device));
 }
 
@@ -849,11 +2671,18 @@ NIF(ifft) {
   TENSOR(mlx::core::fft::ifft(*t, n, axis, device));
 }
 
+// For real inputs the innermost axis goes through the half-spectrum path
+// and only the outer one is a full complex transform
 NIF(emlx_fft2) {
   TENSOR_PARAM(0, t);
   LIST_PARAM(1, std::vector<int>, n);
   LIST_PARAM(2, std::vector<int>, axes);
   DEVICE_PARAM(3, device);
+
+  if (!is_complex(*t) && n.size() == 2 && axes.size() == 2) {
+    TENSOR(mlx::core::fft::fft(real_fft(*t, n[1], axes[1], device), n[0],
+                               axes[0], device));
+  }
   TENSOR(mlx::core::fft::fft2(*t, n, axes, device));
 }
 
@@ -865,6 +2694,203 @@ NIF(ifft2) {
   TENSOR(mlx::core::fft::ifft2(*t, n, axes, device));
 }
 
+NIF(fftn) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::fftn(*t, n, axes, device));
+}
+
+NIF(ifftn) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::ifftn(*t, n, axes, device));
+}
+
+// rfft* return the non-negative frequency half of the last transformed
+// axis (n / 2 + 1 bins); irfft* take that half and the real output length
+NIF(rfft) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, n);
+  PARAM(2, int, axis);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::rfft(*t, n, axis, device));
+}
+
+NIF(irfft) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, n);
+  PARAM(2, int, axis);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::irfft(*t, n, axis, device));
+}
+
+NIF(rfft2) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::rfft2(*t, n, axes, device));
+}
+
+NIF(irfft2) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::irfft2(*t, n, axes, device));
+}
+
+NIF(rfftn) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::rfftn(*t, n, axes, device));
+}
+
+NIF(irfftn) {
+  TENSOR_PARAM(0, t);
+  LIST_PARAM(1, std::vector<int>, n);
+  LIST_PARAM(2, std::vector<int>, axes);
+  DEVICE_PARAM(3, device);
+  TENSOR(mlx::core::fft::irfftn(*t, n, axes, device));
+}
+
+/* Packed sub-byte storage */
+
+// Sub-byte integer tensors ({:u, 2}, {:s, 4}, ...) are stored packed in
+// uint8 arrays, following Nx's bitstring layout: the first element takes
+// the most significant bits of the first byte.
+mlx::core::array packed_shifts(int bits) {
+  int per_byte = 8 / bits;
+  std::vector<uint8_t> shifts(per_byte);
+  for (int i = 0; i < per_byte; i++) {
+    shifts[i] = (per_byte - 1 - i) * bits;
+  }
+  return mlx::core::array(shifts.begin(), {per_byte}, mlx::core::uint8);
+}
+
+NIF(pack_bits) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, bits);
+  DEVICE_PARAM(2, device);
+
+  if (bits != 2 && bits != 4)
+    return nx::nif::error(env, "Only 2 and 4 bit packing is supported");
+
+  int per_byte = 8 / bits;
+
+  try {
+    int size = flat_dim(t->size());
+    int num_bytes = flat_dim((static_cast<uint64_t>(size) + per_byte - 1) /
+                             per_byte);
+
+    auto mask = mlx::core::array((1 << bits) - 1, mlx::core::uint8);
+    auto flat = mlx::core::astype(mlx::core::reshape(*t, {size}, device),
+                                  mlx::core::uint8, device);
+    flat = mlx::core::bitwise_and(flat, mask, device);
+    int padded_size = flat_dim(static_cast<uint64_t>(num_bytes) * per_byte);
+    flat = mlx::core::pad(flat, {0}, {0}, {padded_size - size},
+                          mlx::core::array(0, mlx::core::uint8), "constant",
+                          device);
+
+    auto shifted = mlx::core::left_shift(
+        mlx::core::reshape(flat, {num_bytes, per_byte}, device),
+        packed_shifts(bits), device);
+
+    // The elements occupy disjoint bits, so summing them is a bitwise or
+    TENSOR(mlx::core::astype(mlx::core::sum(shifted, 1, false, device),
+                             mlx::core::uint8, device));
+  }
+  CATCH()
+}
+
+NIF(unpack_bits) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, bits);
+  PARAM(2, bool, is_signed);
+  SHAPE_PARAM(3, shape);
+  DEVICE_PARAM(4, device);
+
+  if (bits != 2 && bits != 4)
+    return nx::nif::error(env, "Only 2 and 4 bit packing is supported");
+
+  int per_byte = 8 / bits;
+  uint64_t size = elem_count(shape);
+  uint64_t num_bytes = t->size();
+
+  if (num_bytes * per_byte < size)
+    return nx::nif::error(env,
+                          "Packed tensor is too small for the requested shape");
+
+  try {
+    auto mask = mlx::core::array((1 << bits) - 1, mlx::core::uint8);
+    auto bytes = mlx::core::reshape(*t, {flat_dim(num_bytes), 1}, device);
+    auto elements = mlx::core::bitwise_and(
+        mlx::core::right_shift(bytes, packed_shifts(bits), device), mask,
+        device);
+    elements = mlx::core::slice(
+        mlx::core::reshape(elements, {flat_dim(num_bytes * per_byte)}, device),
+        {0}, {flat_dim(size)}, device);
+
+    if (is_signed) {
+      // Sign-extend: (x ^ sign_bit) - sign_bit
+      auto sign_bit = mlx::core::array(1 << (bits - 1), mlx::core::int8);
+      elements = mlx::core::astype(elements, mlx::core::int8, device);
+      elements = mlx::core::subtract(
+          mlx::core::bitwise_xor(elements, sign_bit, device), sign_bit, device);
+    }
+
+    TENSOR(mlx::core::reshape(elements, shape, device));
+  }
+  CATCH()
+}
+
+/* 1-byte float8 (E5M2) storage */
+
+// E5M2 has the same sign and exponent layout as float16 with the low
+// 8 mantissa bits dropped, so converting is a shift and a bit-cast.
+NIF(f8_to_f16) {
+  TENSOR_PARAM(0, t);
+  DEVICE_PARAM(1, device);
+
+  try {
+    auto widened = mlx::core::astype(*t, mlx::core::uint16, device);
+    auto shifted = mlx::core::left_shift(
+        widened, mlx::core::array(8, mlx::core::uint16), device);
+    return nx::nif::ok(
+        env, create_tensor_resource(
+                 env, mlx::core::view(shifted, mlx::core::float16, device)));
+  }
+  CATCH()
+}
+
+NIF(f16_to_f8) {
+  TENSOR_PARAM(0, t);
+  PARAM(1, int, nan_byte);
+  DEVICE_PARAM(2, device);
+
+  try {
+    auto half = mlx::core::astype(*t, mlx::core::float16, device);
+    auto bits = mlx::core::view(half, mlx::core::uint16, device);
+    auto truncated = mlx::core::astype(
+        mlx::core::right_shift(bits, mlx::core::array(8, mlx::core::uint16),
+                               device),
+        mlx::core::uint8, device);
+
+    // Truncating the mantissa may turn a NaN into an infinity
+    auto result = mlx::core::where(mlx::core::isnan(half, device),
+                                   mlx::core::array(nan_byte, mlx::core::uint8),
+                                   truncated, device);
+    return nx::nif::ok(env, create_tensor_resource(env, result));
+  }
+  CATCH()
+}
+
 NIF(view) {
   TENSOR_PARAM(0, t);
   TYPE_PARAM(1, type);
@@ -876,6 +2902,14 @@ NIF(max) {
   TENSOR_PARAM(0, t);
   LIST_PARAM(1, std::vector<int>, axes);
   PARAM(2, bool, keep_axes);
+
+  if (argc == 5) {
+    TYPE_PARAM(3, out_type);
+    DEVICE_PARAM(4, device);
+    TENSOR(maybe_astype(mlx::core::max(*t, axes, keep_axes, device),
+                        device_dtype(out_type, device), device));
+  }
+
   DEVICE_PARAM(3, device);
   TENSOR(mlx::core::max(*t, axes, keep_axes, device));
 }
@@ -884,16 +2918,25 @@ NIF(min) {
   TENSOR_PARAM(0, t);
   LIST_PARAM(1, std::vector<int>, axes);
   PARAM(2, bool, keep_axes);
+
+  if (argc == 5) {
+    TYPE_PARAM(3, out_type);
+    DEVICE_PARAM(4, device);
+    TENSOR(maybe_astype(mlx::core::min(*t, axes, keep_axes, device),
+                        device_dtype(out_type, device), device));
+  }
+
   DEVICE_PARAM(3, device);
   TENSOR(mlx::core::min(*t, axes, keep_axes, device));
 }
 
 NIF(clip) {
   TENSOR_PARAM(0, t);
-  TENSOR_PARAM(1, min);
-  TENSOR_PARAM(2, max);
+  OPERAND_PARAM(1, min);
+  OPERAND_PARAM(2, max);
   DEVICE_PARAM(3, device);
-  TENSOR(mlx::core::clip(*t, *min, *max, device));
+  TENSOR(mlx::core::clip(*t, min.to_array(t->dtype()),
+                         max.to_array(t->dtype()), device));
 }
 
 NIF(strides) {
@@ -914,11 +2957,21 @@ NIF(as_strided) {
   TENSOR(mlx::core::as_strided(*t, shape, strides, offset, device));
 }
 
+NIF(run_tape);
+NIF(tape_ops);
+
 static ErlNifFunc nif_funcs[] = {{"strides", 1, strides},
                                  {"as_strided", 5, as_strided},
                                  {"scalar_type", 1, scalar_type},
                                  {"eval", 1, eval},
+                                 {"astype_all", 3, astype_all},
+                                 {"eval_all", 1, eval_all},
+                                 {"share_all", 1, share_all},
                                  {"view", 3, view},
+                                 {"pack_bits", 3, pack_bits},
+                                 {"unpack_bits", 5, unpack_bits},
+                                 {"f8_to_f16", 2, f8_to_f16},
+                                 {"f16_to_f8", 3, f16_to_f8},
                                  {"stack", 3, stack},
                                  {"where", 4, where},
                                  {"concatenate", 3, concatenate},
@@ -927,18 +2980,29 @@ static ErlNifFunc nif_funcs[] = {{"strides", 1, strides},
                                  {"gather", 5, gather},
                                  {"scatter_add", 5, scatter_add},
                                  {"scatter", 5, scatter},
+                                 {"scatter_max", 5, scatter_max},
+                                 {"scatter_min", 5, scatter_min},
+                                 {"scatter_prod", 5, scatter_prod},
                                  {"slice", 5, slice},
                                  {"slice_update", 5, slice_update},
                                  {"squeeze", 3, squeeze},
                                  {"item", 1, item},
                                  {"all", 4, all},
+                                 {"all", 5, all},
                                  {"any", 4, any},
+                                 {"any", 5, any},
                                  {"sum", 4, sum},
+                                 {"sum", 5, sum},
                                  {"product", 4, product},
+                                 {"product", 5, product},
                                  {"argmax", 3, argmax},
                                  {"argmax", 4, argmax},
                                  {"argmin", 3, argmin},
                                  {"argmin", 4, argmin},
+                                 {"softmax", 3, softmax},
+                                 {"log_softmax", 3, log_softmax},
+                                 {"logsumexp", 4, logsumexp},
+                                 {"sample_token", 6, sample_token},
                                  {"cumulative_sum", 5, cumulative_sum},
                                  {"cumulative_product", 5, cumulative_product},
                                  {"cumulative_max", 5, cumulative_max},
@@ -946,9 +3010,12 @@ static ErlNifFunc nif_funcs[] = {{"strides", 1, strides},
                                  {"shape", 1, shape},
                                  {"reshape", 3, reshape},
                                  {"astype", 3, astype},
+                                 {"float64_supported", 0, float64_supported},
                                  {"to_blob", 1, to_blob},
                                  {"to_blob", 2, to_blob},
+                                 {"to_blob", 3, to_blob},
                                  {"from_blob", 4, from_blob},
+                                 {"write_blob", 4, write_blob},
                                  {"scalar_tensor", 3, scalar_tensor},
                                  {"ones", 3, ones},
                                  {"full", 4, full},
@@ -956,12 +3023,33 @@ static ErlNifFunc nif_funcs[] = {{"strides", 1, strides},
                                  {"eye", 4, eye},
                                  {"broadcast_to", 3, broadcast_to},
                                  {"tensordot", 5, tensordot},
-                                 {"einsum", 4, einsum},
+                                 {"matmul", 5, matmul},
+                                 {"addmm", 8, addmm},
+                                 {"gather_mm", 7, gather_mm},
+                                 {"kv_cache_new", 5, kv_cache_new},
+                                 {"kv_cache_append", 4, kv_cache_append},
+                                 {"kv_cache_keys", 3, kv_cache_keys},
+                                 {"kv_cache_values", 3, kv_cache_values},
+                                 {"kv_cache_length", 2, kv_cache_length},
+                                 {"kv_cache_reset", 1, kv_cache_reset},
+                                 {"optim_sgd", 8, optim_sgd},
+                                 {"optim_adam", 13, optim_adam},
+                                 {"loader_new", 5, loader_new},
+                                 {"loader_push", 2, loader_push},
+                                 {"loader_close", 1, loader_close},
+                                 {"executor_submit", 3, executor_submit},
+                                 {"executor_configure", 2, executor_configure},
+                                 {"executor_stats", 0, executor_stats},
+                                 {"einsum", 3, einsum},
                                  {"conv_general", 9, conv_general},
                                  {"transpose", 3, transpose},
                                  {"pad", 6, pad},
-                                 {"sort", 3, sort},
-                                 {"argsort", 3, argsort},
+                                 {"sort", 4, sort},
+                                 {"argsort", 4, argsort},
+                                 {"partition", 4, partition},
+                                 {"argpartition", 4, argpartition},
+                                 {"topk", 4, topk},
+                                 {"argtopk", 4, argtopk},
                                  {"abs", 2, abs},
                                  {"ceil", 2, ceil},
                                  {"conjugate", 2, conjugate},
@@ -996,41 +3084,192 @@ static ErlNifFunc nif_funcs[] = {{"strides", 1, strides},
                                  {"tan", 2, tan},
                                  {"tanh", 2, tanh},
                                  {"add", 3, add},
+                                 {"add", 5, add},
                                  {"subtract", 3, subtract},
+                                 {"subtract", 5, subtract},
                                  {"multiply", 3, multiply},
+                                 {"multiply", 5, multiply},
                                  {"pow", 3, pow},
+                                 {"pow", 5, pow},
                                  {"remainder", 3, remainder},
+                                 {"remainder", 5, remainder},
                                  {"divide", 3, divide},
+                                 {"divide", 5, divide},
                                  {"atan2", 3, atan2},
+                                 {"atan2", 5, atan2},
                                  {"bitwise_and", 3, bitwise_and},
+                                 {"bitwise_and", 5, bitwise_and},
                                  {"bitwise_or", 3, bitwise_or},
+                                 {"bitwise_or", 5, bitwise_or},
                                  {"bitwise_xor", 3, bitwise_xor},
+                                 {"bitwise_xor", 5, bitwise_xor},
                                  {"bitwise_not", 2, bitwise_not},
                                  {"left_shift", 3, left_shift},
+                                 {"left_shift", 5, left_shift},
                                  {"right_shift", 3, right_shift},
+                                 {"right_shift", 5, right_shift},
                                  {"minimum", 3, minimum},
+                                 {"minimum", 5, minimum},
                                  {"maximum", 3, maximum},
+                                 {"maximum", 5, maximum},
                                  {"quotient", 3, quotient},
+                                 {"quotient", 5, quotient},
                                  {"equal", 3, equal},
+                                 {"equal", 5, equal},
                                  {"not_equal", 3, not_equal},
+                                 {"not_equal", 5, not_equal},
                                  {"greater", 3, greater},
+                                 {"greater", 5, greater},
                                  {"less", 3, less},
+                                 {"less", 5, less},
                                  {"greater_equal", 3, greater_equal},
+                                 {"greater_equal", 5, greater_equal},
                                  {"less_equal", 3, less_equal},
+                                 {"less_equal", 5, less_equal},
                                  {"logical_and", 3, logical_and},
+                                 {"logical_and", 5, logical_and},
                                  {"logical_or", 3, logical_or},
+                                 {"logical_or", 5, logical_or},
                                  {"logical_xor", 3, logical_xor},
+                                 {"logical_xor", 5, logical_xor},
                                  {"fft", 4, emlx_fft},
                                  {"ifft", 4, ifft},
                                  {"fft2", 4, emlx_fft2},
                                  {"ifft2", 4, ifft2},
+                                 {"fftn", 4, fftn},
+                                 {"ifftn", 4, ifftn},
+                                 {"rfft", 4, rfft},
+                                 {"irfft", 4, irfft},
+                                 {"rfft2", 4, rfft2},
+                                 {"irfft2", 4, irfft2},
+                                 {"rfftn", 4, rfftn},
+                                 {"irfftn", 4, irfftn},
                                  {"allclose", 6, allclose},
                                  {"isclose", 6, isclose},
                                  {"deallocate", 1, deallocate},
                                  {"max", 4, max},
+                                 {"max", 5, max},
                                  {"min", 4, min},
+                                 {"min", 5, min},
                                  {"clip", 4, clip},
-                                 {"tri_inv", 3, tri_inv}};
+                                 {"tri_inv", 3, tri_inv},
+                                 {"run_tape", 2, run_tape},
+                                 {"tape_ops", 0, tape_ops}};
+
+// The {name, arity} of every NIF, in table order. EMLX.batch/1 records
+// ops by their position here, so running a tape needs no name lookups.
+NIF(tape_ops) {
+  std::vector<ERL_NIF_TERM> ops;
+
+  for (const auto &f : nif_funcs) {
+    ops.push_back(enif_make_tuple2(env, nx::nif::atom(env, f.name),
+                                   nx::nif::make(env, (int)f.arity)));
+  }
+
+  return nx::nif::ok(env,
+                     enif_make_list_from_array(env, ops.data(), ops.size()));
+}
+
+// Replaces {:emlx_slot, n} placeholders, also inside lists, with the
+// tensor produced by the n-th recorded op.
+static bool substitute_slots(ErlNifEnv *env, ERL_NIF_TERM term,
+                             const std::vector<ERL_NIF_TERM> &results,
+                             int64_t base, ERL_NIF_TERM *out) {
+  int arity;
+  const ERL_NIF_TERM *tuple;
+  std::string tag;
+  int64_t slot;
+
+  if (enif_get_tuple(env, term, &arity, &tuple) && arity == 2 &&
+      nx::nif::get_atom(env, tuple[0], tag) && tag == "emlx_slot") {
+    if (!nx::nif::get(env, tuple[1], &slot) || slot < base ||
+        slot - base >= (int64_t)results.size())
+      return false;
+
+    *out = results[slot - base];
+    return true;
+  }
+
+  if (enif_is_list(env, term)) {
+    unsigned int length;
+    enif_get_list_length(env, term, &length);
+    std::vector<ERL_NIF_TERM> items(length);
+    ERL_NIF_TERM head, tail = term;
+
+    for (unsigned int i = 0; i < length; i++) {
+      enif_get_list_cell(env, tail, &head, &tail);
+      if (!substitute_slots(env, head, results, base, &items[i]))
+        return false;
+    }
+
+    *out = enif_make_list_from_array(env, items.data(), length);
+    return true;
+  }
+
+  *out = term;
+  return true;
+}
+
+// Runs the ops recorded by EMLX.batch/1 as [{op, args}], where op is
+// the position of the NIF in nif_funcs (see tape_ops). Slot ids
+// start at base, so later flushes of the same batch can refer to the
+// results of earlier ones by their resolved refs.
+NIF(run_tape) {
+  PARAM(1, int64_t, base);
+
+  unsigned int length;
+  if (!enif_get_list_length(env, argv[0], &length))
+    return nx::nif::error(env, "Unable to get tape param.");
+
+  std::vector<ERL_NIF_TERM> results;
+  results.reserve(length);
+
+  ERL_NIF_TERM entry, tape = argv[0];
+
+  while (enif_get_list_cell(env, tape, &entry, &tape)) {
+    int arity;
+    const ERL_NIF_TERM *op;
+    int index;
+    unsigned int nargs;
+
+    if (!enif_get_tuple(env, entry, &arity, &op) || arity != 2 ||
+        !nx::nif::get(env, op[0], &index) ||
+        !enif_get_list_length(env, op[1], &nargs))
+      return nx::nif::error(env, "Invalid tape entry.");
+
+    if (index < 0 || index >= (int)std::size(nif_funcs))
+      return nx::nif::error(env, "Unknown op in tape entry.");
+
+    const ErlNifFunc &fun = nif_funcs[index];
+
+    if (fun.arity != nargs || fun.fptr == run_tape || fun.fptr == tape_ops)
+      return nx::nif::error(
+          env, ("Invalid op " + std::string(fun.name) + " in tape entry.")
+                   .c_str());
+
+    std::vector<ERL_NIF_TERM> args(nargs);
+    ERL_NIF_TERM arg, rest = op[1];
+
+    for (unsigned int i = 0; i < nargs; i++) {
+      enif_get_list_cell(env, rest, &arg, &rest);
+      if (!substitute_slots(env, arg, results, base, &args[i]))
+        return nx::nif::error(env, "Invalid slot in tape entry.");
+    }
+
+    ERL_NIF_TERM result = fun.fptr(env, nargs, args.data());
+    const ERL_NIF_TERM *tagged;
+    std::string tag;
+
+    if (!enif_get_tuple(env, result, &arity, &tagged) || arity != 2 ||
+        !nx::nif::get_atom(env, tagged[0], tag) || tag != "ok")
+      return result;
+
+    results.push_back(tagged[1]);
+  }
+
+  return nx::nif::ok(
+      env, enif_make_list_from_array(env, results.data(), results.size()));
+}
 
 // Update the NIF initialization
 ERL_NIF_INIT(Elixir.EMLX.NIF, nif_funcs, load, NULL, NULL, NULL)
@@ -2,6 +2,8 @@
 
 #include "erl_nif.h"
 
+#include <limits>
+
 ErlNifResourceType *TENSOR_TYPE;
 
 #define GET(ARGN, VAR)                                                         \
@@ -36,7 +38,14 @@ ErlNifResourceType *TENSOR_TYPE;
   if (!enif_inspect_binary(env, argv[ARGN], &VAR))                             \
     return nx::nif::error(env, "Unable to get " #VAR " binary param.");
 
-#define SHAPE_PARAM(ARGN, VAR) TUPLE_PARAM(ARGN, std::vector<int>, VAR)
+// Shapes are decoded as 64-bit integers and then narrowed to the 32-bit
+// dimensions used by MLX, so oversized dimensions fail instead of wrapping.
+#define SHAPE_PARAM(ARGN, VAR)                                                 \
+  TUPLE_PARAM(ARGN, std::vector<int64_t>, VAR##_int64)                         \
+  std::vector<int> VAR;                                                        \
+  if (!nx::nif::narrow_dims(VAR##_int64, VAR))                                 \
+    return nx::nif::error(env, "Dimension in " #VAR                            \
+                               " does not fit in a 32-bit MLX shape");
 
 #define TYPE_PARAM(ARGN, VAR)                                                  \
   ATOM_PARAM(ARGN, VAR##_atom)                                                 \
@@ -218,6 +227,18 @@ int get(ErlNifEnv *env, ERL_NIF_TERM term, bool *var) {
 
 // Containers
 
+int narrow_dims(const std::vector<int64_t> &dims, std::vector<int> &var) {
+  var.reserve(dims.size());
+
+  for (auto dim : dims) {
+    if (dim < std::numeric_limits<int>::min() ||
+        dim > std::numeric_limits<int>::max())
+      return 0;
+    var.push_back(static_cast<int>(dim));
+  }
+  return 1;
+}
+
 template <typename T = int64_t>
 int get_tuple(ErlNifEnv *env, ERL_NIF_TERM tuple, std::vector<T> &var) {
   const ERL_NIF_TERM *terms;
@@ -280,7 +301,8 @@ int get_list(ErlNifEnv *env, ERL_NIF_TERM list, std::vector<int> &var) {
   ERL_NIF_TERM head, tail;
 
   while (enif_get_list_cell(env, list, &head, &tail)) {
-    int64_t elem;
+    // Fails for values outside of the int range instead of truncating
+    int elem;
     if (!get(env, head, &elem))
       return 0;
     var.push_back(elem);
@@ -35,14 +35,19 @@ defmodule EMLX.Macro do
       raise("At least one argument of defdevice function should be named 'device'.")
     end
 
-    tensors =
+    {tensors, fast_clause} =
       case tensors(args) do
-        [] -> :ok
-        tensors -> quote do: {unquote(tensors), _} = prepare_tensors!(unquote(tensors))
+        [] ->
+          {:ok, device_fast_clause(name, args)}
+
+        tensors ->
+          {quote(do: {unquote(tensors), _} = prepare_tensors!(unquote(tensors))), nil}
       end
 
     quote do
       @mlx_function {unquote(name), unquote(length(args))}
+      unquote(fast_clause)
+
       def unquote(name)(unquote_splicing(args)) do
         unquote(tensors)
         {user_device, index} = normalize_device!(var!(device))
@@ -80,13 +85,125 @@ defmodule EMLX.Macro do
       raise ArgumentError, "at least one tensor required in #{name}/#{length(args)}"
     end
 
+    body =
+      case unwrapper do
+        # Values need the pending ops of EMLX.batch/1, tensor ops are recorded
+        :unwrap! ->
+          quote do
+            flush_tape!()
+            {unquote(tensors), device} = prepare_tensors!(unquote(tensors))
+            EMLX.NIF.unquote(name)(unquote_splicing(args)) |> unwrap!()
+          end
+
+        :unwrap_tensor! ->
+          quote do
+            {unquote(tensors), device} = prepare_tensors!(unquote(tensors))
+
+            if tape_active?() do
+              record!(unquote(name), unquote(args ++ extra), device)
+            else
+              EMLX.NIF.unquote(name)(unquote_splicing(args ++ extra))
+              |> unwrap_tensor!(device)
+            end
+          end
+      end
+
     quote do
       @mlx_function {unquote(name), unquote(length(args) + length(extra))}
+      unquote(tensor_fast_clause(name, args, tensors, unwrapper, extra))
+
       def unquote(name)(unquote_splicing(args)) do
-        {unquote(tensors), device} = prepare_tensors!(unquote(tensors))
+        unquote(body)
+      end
+    end
+  end
+
+  # The clauses below handle the common case without prepare_tensors!,
+  # normalize_device! or unwrap_tensor!. Tensors are destructured in the
+  # head, the device is merged inline and anything else (lists of tensors,
+  # scalars, tensors recorded by EMLX.batch/1, {device, index} tuples and
+  # errors) falls through to the general clause.
+  defp device_fast_clause(name, args) do
+    device = Enum.find(args, &match?({:device, _, _}, &1))
 
-        EMLX.NIF.unquote(name)(unquote_splicing(args ++ extra))
-        |> unquote(unwrapper)(unquote_splicing(extra))
+    quote do
+      def unquote(name)(unquote_splicing(args)) when unquote(device) in [:cpu, :gpu] do
+        case EMLX.NIF.unquote(name)(unquote_splicing(args)) do
+          {:ok, ref} when is_reference(ref) -> {unquote(device), ref}
+          result -> unwrap_tensor!(result, unquote(device))
+        end
+      end
+    end
+  end
+
+  defp tensor_fast_clause(name, args, tensors, unwrapper, extra) do
+    pairs =
+      tensors
+      |> Enum.with_index()
+      |> Map.new(fn {{tensor_name, _, _}, i} ->
+        {tensor_name, {Macro.var(:"dev#{i}", __MODULE__), Macro.var(:"ref#{i}", __MODULE__)}}
+      end)
+
+    head_args =
+      Enum.map(args, fn {arg_name, _, _} = arg ->
+        case pairs do
+          %{^arg_name => {dev, ref}} -> quote(do: {unquote(dev), unquote(ref)})
+          %{} -> arg
+        end
+      end)
+
+    call_args =
+      Enum.map(args, fn {arg_name, _, _} = arg ->
+        case pairs do
+          %{^arg_name => {_dev, ref}} -> ref
+          %{} -> arg
+        end
+      end)
+
+    guards =
+      pairs
+      |> Map.values()
+      |> Enum.map(fn {dev, ref} -> quote(do: is_tensor(unquote(dev), unquote(ref))) end)
+      |> Enum.reduce(&quote(do: unquote(&2) and unquote(&1)))
+
+    call = quote(do: EMLX.NIF.unquote(name)(unquote_splicing(call_args ++ extra)))
+
+    body =
+      case unwrapper do
+        :unwrap! ->
+          quote do
+            flush_tape!()
+
+            case unquote(call) do
+              {:ok, result} -> result
+              result -> unwrap!(result)
+            end
+          end
+
+        :unwrap_tensor! ->
+          on_gpu =
+            pairs
+            |> Map.values()
+            |> Enum.map(fn {dev, _ref} -> quote(do: unquote(dev) == :gpu) end)
+            |> Enum.reduce(&quote(do: unquote(&2) or unquote(&1)))
+
+          quote do
+            device = if unquote(on_gpu), do: :gpu, else: :cpu
+
+            if tape_active?() do
+              record!(unquote(name), unquote(call_args ++ extra), device)
+            else
+              case unquote(call) do
+                {:ok, ref} when is_reference(ref) -> {device, ref}
+                result -> unwrap_tensor!(result, device)
+              end
+            end
+          end
+      end
+
+    quote do
+      def unquote(name)(unquote_splicing(head_args)) when unquote(guards) do
+        unquote(body)
       end
     end
   end
@@ -105,6 +222,13 @@ defmodule EMLX do
 
   defguard is_tensor(device, ref) when is_reference(ref) and is_atom(device)
 
+  # Placeholder for the result of an op recorded by batch/1
+  defguardp is_slot(device, slot)
+            when is_atom(device) and is_tuple(slot) and tuple_size(slot) == 2 and
+                   elem(slot, 0) == :emlx_slot
+
+  @tape_key {__MODULE__, :tape}
+
   ## Macro callbacks
 
   defp normalize_device!({device, index}) when is_atom(device) and is_integer(index),
@@ -138,6 +262,10 @@ defmodule EMLX do
   deftensor astype(tensor, type)
   deftensor as_strided(tensor, shape, strides, offset)
   deftensor view(tensor, type)
+  deftensor pack_bits(tensor, bits)
+  deftensor unpack_bits(tensor, bits, signed, shape)
+  deftensor f8_to_f16(tensor)
+  deftensor f16_to_f8(tensor, nan_byte)
 
   ## Binary ops
   deftensor add(tensorA, tensorB)
@@ -166,20 +294,61 @@ defmodule EMLX do
   deftensor logical_or(tensorA, tensorB)
   deftensor logical_xor(tensorA, tensorB)
 
+  ## Binary ops that promote to compute_type and cast to out_type
+  deftensor add(tensorA, tensorB, compute_type, out_type)
+  deftensor subtract(tensorA, tensorB, compute_type, out_type)
+  deftensor multiply(tensorA, tensorB, compute_type, out_type)
+  deftensor pow(tensorA, tensorB, compute_type, out_type)
+  deftensor remainder(tensorA, tensorB, compute_type, out_type)
+  deftensor divide(tensorA, tensorB, compute_type, out_type)
+  deftensor atan2(tensorA, tensorB, compute_type, out_type)
+  deftensor bitwise_and(tensorA, tensorB, compute_type, out_type)
+  deftensor bitwise_or(tensorA, tensorB, compute_type, out_type)
+  deftensor bitwise_xor(tensorA, tensorB, compute_type, out_type)
+  deftensor left_shift(tensorA, tensorB, compute_type, out_type)
+  deftensor right_shift(tensorA, tensorB, compute_type, out_type)
+  deftensor minimum(tensorA, tensorB, compute_type, out_type)
+  deftensor maximum(tensorA, tensorB, compute_type, out_type)
+  deftensor quotient(tensorA, tensorB, compute_type, out_type)
+  deftensor equal(tensorA, tensorB, compute_type, out_type)
+  deftensor not_equal(tensorA, tensorB, compute_type, out_type)
+  deftensor greater(tensorA, tensorB, compute_type, out_type)
+  deftensor less(tensorA, tensorB, compute_type, out_type)
+  deftensor greater_equal(tensorA, tensorB, compute_type, out_type)
+  deftensor less_equal(tensorA, tensorB, compute_type, out_type)
+  deftensor logical_and(tensorA, tensorB, compute_type, out_type)
+  deftensor logical_or(tensorA, tensorB, compute_type, out_type)
+  deftensor logical_xor(tensorA, tensorB, compute_type, out_type)
+
   deftensor fft(tensor, n, axis)
   deftensor ifft(tensor, n, axis)
   deftensor fft2(tensor, s, axes)
   deftensor ifft2(tensor, s, axes)
+  deftensor fftn(tensor, s, axes)
+  deftensor ifftn(tensor, s, axes)
+  deftensor rfft(tensor, n, axis)
+  deftensor irfft(tensor, n, axis)
+  deftensor rfft2(tensor, s, axes)
+  deftensor irfft2(tensor, s, axes)
+  deftensor rfftn(tensor, s, axes)
+  deftensor irfftn(tensor, s, axes)
 
   deftensor allclose(tensorA, tensorB, rtol, atol, equal_nan)
   deftensor isclose(tensorA, tensorB, rtol, atol, equal_nan)
 
   deftensor tensordot(tensorA, tensorB, axesA, axesB)
-  deftensor einsum(tensorA, tensorB, spec_string)
+  deftensor matmul(tensorA, tensorB, compute_type, out_type)
+  deftensor addmm(tensorC, tensorA, tensorB, alpha, beta, compute_type, out_type)
+  deftensor gather_mm(tensorA, tensorB, tensorL, tensorR, compute_type, out_type)
+  deftensor einsum(tensors, spec_string)
   deftensor transpose(tensor, axes)
   deftensor pad(tensor, axes, low_pad_size, high_pad_size, pad_value)
-  deftensor sort(tensor, axis)
-  deftensor argsort(tensor, axis)
+  deftensor sort(tensor, axis, descending)
+  deftensor argsort(tensor, axis, descending)
+  deftensor partition(tensor, kth, axis)
+  deftensor argpartition(tensor, kth, axis)
+  deftensor topk(tensor, k, axis)
+  deftensor argtopk(tensor, k, axis)
   deftensor tri_inv(tensor, upper)
 
   deftensor conv_general(
@@ -231,13 +400,21 @@ defmodule EMLX do
 
   ## Aggregation
   deftensor all(tensor, axes, keep_axes)
+  deftensor all(tensor, axes, keep_axes, out_type)
   deftensor any(tensor, axes, keep_axes)
+  deftensor any(tensor, axes, keep_axes, out_type)
   deftensor sum(tensor, axes, keep_axes)
+  deftensor sum(tensor, axes, keep_axes, out_type)
   deftensor product(tensor, axes, keep_axes)
+  deftensor product(tensor, axes, keep_axes, out_type)
   deftensor argmax(tensor, keep_axes)
   deftensor argmax(tensor, axes, keep_axes)
   deftensor argmin(tensor, keep_axes)
   deftensor argmin(tensor, axes, keep_axes)
+  deftensor softmax(tensor, axes)
+  deftensor log_softmax(tensor, axes)
+  deftensor logsumexp(tensor, axes, keep_axes)
+  deftensor sample_token(tensor, tensor_key, temperature, top_k, top_p)
   deftensor cumulative_sum(tensor, axis, reverse, inclusive)
   deftensor cumulative_product(tensor, axis, reverse, inclusive)
   deftensor cumulative_max(tensor, axis, reverse, inclusive)
@@ -250,13 +427,41 @@ defmodule EMLX do
   deftensor gather(tensor, indices, axes, slice_sizes)
   deftensor scatter_add(tensor, indices, tensor_updates, axes)
   deftensor scatter(tensor, indices, tensor_updates, axes)
+  deftensor scatter_max(tensor, indices, tensor_updates, axes)
+  deftensor scatter_min(tensor, indices, tensor_updates, axes)
+  deftensor scatter_prod(tensor, indices, tensor_updates, axes)
   deftensor max(tensor, axes, keep_axes)
+  deftensor max(tensor, axes, keep_axes, out_type)
   deftensor min(tensor, axes, keep_axes)
+  deftensor min(tensor, axes, keep_axes, out_type)
   deftensor clip(tensor, tensor_min, tensor_max)
 
+  ## Capabilities
+
+  @mlx_function {:float64_supported, 0}
+
+  @doc """
+  Returns true if EMLX was built against an MLX version that
+  supports float64. float64 is only computed on the `:cpu` device.
+  """
+  def float64_supported? do
+    # Fixed at build time, and asked on every f64 op by the backend
+    case :persistent_term.get({__MODULE__, :float64_supported}, nil) do
+      nil ->
+        supported? = EMLX.NIF.float64_supported() |> unwrap!()
+        :persistent_term.put({__MODULE__, :float64_supported}, supported?)
+        supported?
+
+      supported? ->
+        supported?
+    end
+  end
+
   ## Dirty non-tensor return values
   defvalue to_blob(tensor)
   defvalue to_blob(tensor, limit)
+  defvalue to_blob(tensor, limit, type)
+  defvalue write_blob(tensor, blob, starts, shape)
   defvalue scalar_type(tensor)
   defvalue shape(tensor)
 
@@ -282,6 +487,9 @@ defmodule EMLX do
       {dev, ref}, device when is_tensor(dev, ref) ->
         {ref, merge_device(device, dev)}
 
+      {dev, slot}, device when is_slot(dev, slot) ->
+        {resolve_slot!(slot), merge_device(device, dev)}
+
       bad_tensor, _device ->
         raise ArgumentError, "expected a EMLX tensor, got: #{inspect(bad_tensor)}"
     end)
@@ -292,14 +500,300 @@ defmodule EMLX do
       {dev, ref}, device when is_tensor(dev, ref) ->
         {ref, merge_device(device, dev)}
 
-      [{dev, ref} | _] = tensors, device when is_tensor(dev, ref) ->
+      {dev, slot}, device when is_slot(dev, slot) ->
+        {resolve_slot!(slot), merge_device(device, dev)}
+
+      [{dev, ref} | _] = tensors, device when is_tensor(dev, ref) or is_slot(dev, ref) ->
         prepare_tensors_list!(tensors, device)
 
+      # Binary ops and clip also accept scalars in place of tensors
+      scalar, device when is_number(scalar) ->
+        {scalar, device}
+
+      {re, im} = scalar, device when is_number(re) and is_number(im) ->
+        {scalar, device}
+
       bad_tensor, _device ->
         raise ArgumentError, "expected a EMLX tensor, got: #{inspect(bad_tensor)}"
     end)
   end
 
+  ## KV cache
+
+  # The cache resource travels as {device, ref}, like a tensor, so it is
+  # named tensor_cache for the macros to pick up its device
+  defdevice kv_cache_new(layers, shape, type, ring, device)
+  defvalue kv_cache_append(tensor_cache, layer, tensor_keys, tensor_values)
+  deftensor kv_cache_keys(tensor_cache, layer)
+  deftensor kv_cache_values(tensor_cache, layer)
+  defvalue kv_cache_length(tensor_cache, layer)
+  defvalue kv_cache_reset(tensor_cache)
+
+  ## Optimizers
+
+  # Each returns a flat list of refs: the params followed by each state
+  defvalue optim_sgd(
+             tensors_params,
+             tensors_grads,
+             tensors_traces,
+             learning_rate,
+             momentum,
+             weight_decay,
+             nesterov,
+             device
+           )
+
+  defvalue optim_adam(
+             tensors_params,
+             tensors_grads,
+             tensors_mus,
+             tensors_nus,
+             learning_rate,
+             b1,
+             b2,
+             eps,
+             l2_decay,
+             decoupled_decay,
+             c1,
+             c2,
+             device
+           )
+
+  ## Data loader
+
+  # Like the KV cache, the loader travels as {device, ref}. Batches are
+  # sent to the calling process as {tag, {:ok, ref}} or {tag, {:error, msg}}
+  defdevice loader_new(shape, in_type, out_type, tag, device)
+  defvalue loader_push(tensor_loader, binary)
+  defvalue loader_close(tensor_loader)
+
+  ## Executor
+
+  # Replies to the calling process with {tag, result, queue_us, run_us}
+  defvalue executor_submit(tensors, interactive, tag)
+
+  @mlx_function {:executor_configure, 2}
+  @mlx_function {:executor_stats, 0}
+
+  @doc false
+  def executor_configure(max_concurrency, max_queue),
+    do: EMLX.NIF.executor_configure(max_concurrency, max_queue) |> unwrap!()
+
+  @doc false
+  def executor_stats, do: EMLX.NIF.executor_stats() |> unwrap!()
+
+  ## Containers
+
+  defvalue astype_all(tensors, type, device)
+  defvalue eval_all(tensors)
+  defvalue share_all(tensors)
+
+  @doc """
+  Casts the floating point tensors of an `Nx.Container`, such as a model
+  state map, to `type`.
+
+  Every tensor already on `EMLX.Backend` is cast in a single NIF call,
+  so switching the precision of a model costs one call rather than one
+  per tensor. Integer tensors are left as they are.
+  """
+  def tree_astype(container, type), do: EMLX.Backend.tree_astype(container, type)
+
+  @doc """
+  Moves the tensors of an `Nx.Container` to `device` (`:cpu` or `:gpu`).
+
+  MLX arrays live in unified memory, so tensors already on
+  `EMLX.Backend` are retagged without copying their data, all in one
+  NIF call. Tensors on other backends are uploaded. The given tensors
+  are deallocated.
+  """
+  def tree_transfer(container, device) when device in [:cpu, :gpu],
+    do: EMLX.Backend.tree_transfer(container, device)
+
+  @doc """
+  Evaluates every pending computation behind the tensors of an
+  `Nx.Container` in one `mlx::core::eval` call and returns the container.
+  """
+  def tree_eval(container), do: EMLX.Backend.tree_eval(container)
+
+  ## Segment reductions
+
+  @segment_ops [:sum, :mean, :max, :min, :prod]
+
+  @doc """
+  Reduces the rows of `data` that share a segment id.
+
+  `segment_ids` has one integer id in `0..num_segments - 1` per entry of
+  the first axis of `data`, in any order, and ids outside that range
+  raise. The result has `num_segments` rows and `data`'s remaining axes,
+  where each row is the `op`
+  (`#{Enum.map_join(@segment_ops, ", ", &inspect/1)}`) of the rows
+  assigned to it:
+
+      # Max-aggregate edge messages into their destination nodes
+      EMLX.segment_reduce(messages, destinations, num_nodes, :max)
+
+  Each reduction is a single scatter over `data`, and `:mean` adds a
+  second one over `segment_ids` for the counts. Empty segments hold the
+  identity of `op`: zero for `:sum` and `:mean`, one for `:prod` and the
+  lowest or highest value of the type for `:max` and `:min`.
+  """
+  def segment_reduce(%Nx.Tensor{} = data, segment_ids, num_segments, op)
+      when op in @segment_ops and is_integer(num_segments) and num_segments >= 0 do
+    segment_ids = Nx.to_tensor(segment_ids)
+    [num_rows | inner] = Tuple.to_list(data.shape)
+
+    unless segment_ids.shape == {num_rows} and Nx.Type.integer?(segment_ids.type) do
+      raise ArgumentError,
+            "expected segment_ids to be an integer tensor of shape #{inspect({num_rows})}, " <>
+              "got: #{inspect(segment_ids)}"
+    end
+
+    # MLX scatters do not bounds-check indices on the GPU, so ids are
+    # checked here at the cost of reading back their range
+    if num_rows > 0 do
+      range = Nx.stack([Nx.reduce_min(segment_ids), Nx.reduce_max(segment_ids)])
+      [min_id, max_id] = Nx.to_flat_list(range)
+
+      unless min_id >= 0 and max_id < num_segments do
+        raise ArgumentError,
+              "expected segment_ids to be in 0..#{num_segments - 1}, " <>
+                "got ids in #{min_id}..#{max_id}"
+      end
+    end
+
+    type = if op == :mean, do: Nx.Type.to_floating(data.type), else: data.type
+    out = Nx.template(List.to_tuple([num_segments | inner]), type)
+
+    EMLX.Backend.segment_reduce(out, data, segment_ids, op)
+  end
+
+  ## Batching
+
+  @mlx_function {:run_tape, 2}
+  @mlx_function {:tape_ops, 0}
+
+  @doc """
+  Runs `fun` and records the tensor operations it issues instead of
+  calling MLX for each of them.
+
+  The recorded operations are submitted in a single NIF call whenever
+  a value is read (`to_binary`, `item`, `shape` and so on) and when
+  `fun` returns. Tensors in the returned value, including those nested
+  in lists and `Nx.Container`s, are resolved to regular tensors.
+  Tensors created inside the block that are not returned cannot be used
+  after it.
+
+      EMLX.batch(fn ->
+        x |> Nx.multiply(0.5) |> Nx.add(1) |> Nx.exp()
+      end)
+
+  Nested calls run as part of the outermost batch.
+  """
+  def batch(fun) when is_function(fun, 0) do
+    if tape_active?() do
+      fun.()
+    else
+      Process.put(@tape_key, %{entries: [], count: 0, resolved: %{}})
+
+      try do
+        result = fun.()
+        flush_tape!()
+        resolve_slots(result, Process.get(@tape_key).resolved)
+      after
+        Process.delete(@tape_key)
+      end
+    end
+  end
+
+  defp tape_active?, do: Process.get(@tape_key) != nil
+
+  defp record!(name, args, device) do
+    %{entries: entries, count: count} = tape = Process.get(@tape_key)
+    entry = {op_code!(name, length(args)), args}
+    Process.put(@tape_key, %{tape | entries: [entry | entries], count: count + 1})
+    {device, {:emlx_slot, count}}
+  end
+
+  # Tape entries refer to NIFs by their position in the NIF table,
+  # fetched once per VM
+  defp op_code!(name, arity) do
+    codes =
+      case :persistent_term.get({__MODULE__, :op_codes}, nil) do
+        nil ->
+          codes = EMLX.NIF.tape_ops() |> unwrap!() |> Enum.with_index() |> Map.new()
+          :persistent_term.put({__MODULE__, :op_codes}, codes)
+          codes
+
+        codes ->
+          codes
+      end
+
+    Map.fetch!(codes, {name, arity})
+  end
+
+  defp flush_tape! do
+    case Process.get(@tape_key) do
+      %{entries: [_ | _] = entries, count: count, resolved: resolved} = tape ->
+        base = count - length(entries)
+        refs = EMLX.NIF.run_tape(Enum.reverse(entries), base) |> unwrap!()
+
+        resolved =
+          refs
+          |> Enum.with_index(base)
+          |> Enum.into(resolved, fn {ref, slot} -> {slot, ref} end)
+
+        Process.put(@tape_key, %{tape | entries: [], resolved: resolved})
+
+      _ ->
+        :ok
+    end
+  end
+
+  # Unresolved slots are left for run_tape to substitute
+  defp resolve_slot!({:emlx_slot, id} = slot) do
+    case Process.get(@tape_key) do
+      %{resolved: %{^id => ref}} ->
+        ref
+
+      %{} ->
+        slot
+
+      nil ->
+        raise ArgumentError,
+              "tensor was created inside EMLX.batch/1 but was not returned from it"
+    end
+  end
+
+  defp resolve_slots({dev, {:emlx_slot, id}}, resolved) when is_atom(dev),
+    do: {dev, Map.fetch!(resolved, id)}
+
+  defp resolve_slots(%Nx.Tensor{data: %EMLX.Backend{ref: ref} = data} = tensor, resolved),
+    do: %{tensor | data: %{data | ref: resolve_slots(ref, resolved)}}
+
+  defp resolve_slots(tuple, resolved) when is_tuple(tuple),
+    do: tuple |> Tuple.to_list() |> resolve_slots(resolved) |> List.to_tuple()
+
+  defp resolve_slots(list, resolved) when is_list(list),
+    do: Enum.map(list, &resolve_slots(&1, resolved))
+
+  defp resolve_slots(%Complex{} = complex, _resolved), do: complex
+
+  # Tensors on other backends have no slots, and traversing them would
+  # hand the same tensor back
+  defp resolve_slots(%Nx.Tensor{} = tensor, _resolved), do: tensor
+
+  # Other structs only go through the container protocol when they
+  # implement it, rather than falling back to Any
+  defp resolve_slots(container, resolved) when is_map(container) do
+    if Nx.Container.impl_for(container) not in [nil, Nx.Container.Any] do
+      Nx.Defn.Composite.traverse(container, &resolve_slots(&1, resolved))
+    else
+      container
+    end
+  end
+
+  defp resolve_slots(other, _resolved), do: other
+
   defp merge_device(:gpu, _), do: :gpu
   defp merge_device(_, :gpu), do: :gpu
   defp merge_device(_, _), do: :cpu
@@ -335,20 +829,34 @@ defmodule EMLX do
 
     [result] = fun.(args_list)
 
-    Nx.Defn.Composite.traverse(result, fn
-      %Nx.Tensor{data: %EMLX.Backend{ref: ref}} = node ->
-        :ok = eval(ref)
-        node
-
-      other ->
-        other
-    end)
+    case opts[:priority] do
+      nil ->
+        Nx.Defn.Composite.traverse(result, fn
+          %Nx.Tensor{data: %EMLX.Backend{ref: nil}} = node ->
+            node
+
+          %Nx.Tensor{data: %EMLX.Backend{ref: ref}} = node ->
+            :ok = eval(ref)
+            node
+
+          other ->
+            other
+        end)
+
+      priority ->
+        case EMLX.Executor.eval(result, priority: priority) do
+          {:ok, _} -> :ok
+          {:error, :overloaded} -> raise EMLX.NIFError, "EMLX executor queue is full"
+        end
+    end
 
     [result]
   end
 
   @impl Nx.Defn.Compiler
-  defdelegate __compile__(key, vars, fun, opts), to: Nx.Defn.Evaluator
+  def __compile__(key, vars, fun, opts) do
+    Nx.Defn.Evaluator.__compile__(key, vars, &EMLX.Fast.rewrite(fun.(&1)), opts)
+  end
 
   @impl Nx.Defn.Compiler
   defdelegate __partitions_options__(opts), to: Nx.Defn.Evaluator
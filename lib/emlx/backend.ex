@@ -4,7 +4,18 @@ defmodule EMLX.Backend do
   alias Nx.Tensor, as: T
   alias EMLX.Backend, as: Backend
 
-  defstruct [:ref, :shape, :type, :data]
+  # Scalar constants are kept in `:scalar` as `{device, value}` with a
+  # nil `:ref` until an op needs them as an MLX array, see from_nx/1
+  defstruct [:ref, :shape, :type, :data, :scalar]
+
+  # Sub-byte integer types are stored packed into uint8 arrays and
+  # {:f, 8} is stored as its raw E5M2 bytes. Both are decoded on read
+  # by from_nx/1 and encoded again by to_nx/2.
+  @packed_bits [2, 4]
+  @f8_nan :binary.first(Nx.Type.nan_binary({:f, 8}))
+
+  # MLX shapes use 32-bit dimensions
+  @max_mlx_dim 2 ** 31 - 1
 
   @impl true
   def init(opts) do
@@ -14,6 +25,19 @@ defmodule EMLX.Backend do
   @doc """
   Converts from an Nx tensor to an MLX array.
   """
+  def from_nx(%T{data: %Backend{ref: nil, scalar: {device, scalar}}, type: type}) do
+    EMLX.scalar_tensor(scalar, to_mlx_type(type), device)
+  end
+
+  def from_nx(%T{data: %Backend{ref: device_ref}, type: {kind, bits}, shape: shape})
+      when bits in @packed_bits do
+    EMLX.unpack_bits(device_ref, bits, kind == :s, shape)
+  end
+
+  def from_nx(%T{data: %Backend{ref: device_ref}, type: {:f, 8}}) do
+    EMLX.f8_to_f16(device_ref)
+  end
+
   def from_nx(%T{data: %Backend{ref: device_ref}}) do
     device_ref
   end
@@ -23,8 +47,7 @@ defmodule EMLX.Backend do
   @doc """
   Converts an MLX array to an Nx tensor.
   """
-  def to_nx({device, ref} = device_ref)
-      when is_atom(device) and is_reference(ref) do
+  def to_nx({device, _ref} = device_ref) when is_atom(device) do
     # Get the MLX array's type
     mlx_type = EMLX.scalar_type(device_ref)
     shape = EMLX.shape(device_ref)
@@ -35,6 +58,29 @@ defmodule EMLX.Backend do
   @doc """
   Converts an MLX array back to an Nx tensor with type and shape assertions.
   """
+  def to_nx({device, _ref} = device_ref, %T{type: {_, bits}} = t)
+      when is_atom(device) and bits in @packed_bits do
+    device_ref
+    |> EMLX.pack_bits(bits)
+    |> storage_to_nx(t, {packed_byte_size(Nx.size(t.shape), bits)})
+  end
+
+  def to_nx({device, _ref} = device_ref, %T{type: {:f, 8}, shape: shape} = t)
+      when is_atom(device) do
+    device_ref
+    |> EMLX.f16_to_f8(@f8_nan)
+    |> storage_to_nx(t, shape)
+  end
+
+  # Ops recorded by EMLX.batch/1 have not run yet, so there is nothing
+  # to check. The typed ops already produce the expected type, only the
+  # bool to u8 conversion is recorded as well.
+  def to_nx({device, {:emlx_slot, _}} = device_ref, %T{type: type, shape: shape} = t)
+      when is_atom(device) do
+    ref = if type == {:u, 8}, do: EMLX.astype(device_ref, :uint8), else: device_ref
+    %T{t | data: %Backend{ref: ref, shape: shape, type: type}}
+  end
+
   def to_nx({device, ref} = device_ref, %T{type: type, shape: shape} = t)
       when is_atom(device) and is_reference(ref) do
     # Get the MLX array's type
@@ -54,7 +100,36 @@ defmodule EMLX.Backend do
     }
   end
 
+  defp storage_to_nx({_, {:emlx_slot, _}} = storage_ref, %T{type: type, shape: shape} = t, _) do
+    %T{t | data: %Backend{ref: storage_ref, shape: shape, type: type}}
+  end
+
+  defp storage_to_nx(storage_ref, %T{type: type, shape: shape} = t, storage_shape) do
+    if EMLX.shape(storage_ref) != storage_shape or EMLX.scalar_type(storage_ref) != :uint8 do
+      raise "storage mismatch in EMLX for #{inspect(type)} tensor " <>
+              "of shape #{inspect(shape)}. Please report this bug"
+    end
+
+    %T{t | data: %Backend{ref: storage_ref, shape: shape, type: type}}
+  end
+
+  defp packed_byte_size(size, bits), do: div(size * bits + 7, 8)
+
+  # Binary ops and clip take scalars directly, everything else goes
+  # through from_nx/1
+  defp from_nx_or_scalar(%T{data: %Backend{ref: nil, scalar: {_device, scalar}}}), do: scalar
+  defp from_nx_or_scalar(t), do: from_nx(t)
+
+  defp materialize(%T{data: %Backend{ref: nil}} = t), do: t |> from_nx() |> to_nx(t)
+  defp materialize(t), do: t
+
   @impl true
+  def backend_copy(%T{data: %Backend{ref: {_, ref}}} = tensor, Backend, opts)
+      when is_reference(ref) do
+    [copy] = tree_copy([tensor], device_option(opts))
+    copy
+  end
+
   def backend_copy(%T{type: type, shape: shape} = tensor, backend, opts) do
     Nx.from_binary(to_binary(tensor, Nx.size(tensor)), type, backend: {backend, opts})
     |> Nx.reshape(shape)
@@ -68,6 +143,8 @@ defmodule EMLX.Backend do
   end
 
   @impl true
+  def backend_deallocate(%T{data: %Backend{ref: nil}}), do: :ok
+
   def backend_deallocate(%T{data: %Backend{ref: ref}}) do
     EMLX.deallocate(ref)
   end
@@ -83,12 +160,47 @@ defmodule EMLX.Backend do
   end
 
   @impl true
+  def to_binary(%T{data: %Backend{ref: nil}} = tensor, limit) do
+    tensor |> materialize() |> to_binary(limit)
+  end
+
+  def to_binary(%T{type: {_, bits}, data: %Backend{ref: packed_ref}}, limit)
+      when bits in @packed_bits do
+    # The packed buffer already has Nx's bitstring layout
+    bit_size = limit * bits
+    blob = EMLX.to_blob(packed_ref, packed_byte_size(limit, bits))
+    <<binary::bitstring-size(bit_size), _::bitstring>> = blob
+    binary
+  end
+
+  def to_binary(%T{type: {:f, 8}, data: %Backend{ref: storage_ref}}, limit) do
+    EMLX.to_blob(storage_ref, limit)
+  end
+
   def to_binary(tensor, limit) do
-    EMLX.to_blob(from_nx(tensor), limit)
-    |> maybe_modify_binary(to_nx_type(to_mlx_type(tensor.type)), tensor.type)
+    blob_type = to_blob_type(tensor.type)
+
+    EMLX.to_blob(from_nx(tensor), limit, blob_type)
+    |> maybe_modify_binary(to_nx_type(blob_type), tensor.type)
   end
 
   @impl true
+  def from_binary(%T{type: {_, bits}} = out, binary, backend_options)
+      when bits in @packed_bits do
+    padding = rem(8 - rem(bit_size(binary), 8), 8)
+    blob = <<binary::bitstring, 0::size(padding)>>
+
+    blob
+    |> EMLX.from_blob({byte_size(blob)}, :uint8, device_option(backend_options))
+    |> storage_to_nx(out, {byte_size(blob)})
+  end
+
+  def from_binary(%T{type: {:f, 8}, shape: shape} = out, binary, backend_options) do
+    binary
+    |> EMLX.from_blob(shape, :uint8, device_option(backend_options))
+    |> storage_to_nx(out, shape)
+  end
+
   def from_binary(%T{type: type, shape: shape} = out, binary, backend_options) do
     binary
     |> maybe_modify_binary(type, to_nx_type(to_mlx_type(type)))
@@ -100,37 +212,44 @@ defmodule EMLX.Backend do
     |> to_nx(out)
   end
 
-  defp maybe_modify_binary(binary, type, type), do: binary
-
-  defp maybe_modify_binary(binary, {:f, 8}, {:f, 16}) do
-    for <<byte::8 <- binary>>, into: <<>> do
-      case read_f8(<<byte::8>>) do
-        :nan ->
-          Nx.Type.nan_binary({:f, 16})
+  @doc """
+  Writes `binary` in place into the region of `tensor` that starts at
+  `start_indices` and has shape `slice_shape`.
 
-        :infinity ->
-          Nx.Type.infinity_binary({:f, 16})
+  Unlike `Nx.put_slice/3`, no new tensor is allocated. The binary must
+  hold the region's elements in row-major order and in the tensor type.
 
-        :neg_infinity ->
-          Nx.Type.neg_infinity_binary({:f, 16})
+  The write fails if the tensor's buffer is shared with any other
+  MLX array, such as views or lazy computations that still read it.
+  """
+  def write_binary(%T{type: {_, bits}}, _binary, _start_indices, _slice_shape)
+      when bits in @packed_bits do
+    raise ArgumentError, "write_binary/4 is not supported for packed sub-byte types"
+  end
 
-        number ->
-          <<number::float-native-size(16)>>
-      end
-    end
+  def write_binary(%T{data: %Backend{ref: nil}} = tensor, binary, start_indices, slice_shape) do
+    tensor |> materialize() |> write_binary(binary, start_indices, slice_shape)
   end
 
-  defp maybe_modify_binary(binary, {:f, 16}, {:f, 8}) do
-    for <<float::16 <- binary>>, into: <<>> do
-      case <<float::16-native>> do
-        <<float::float-native-16>> -> write_finite_f8(float)
-        <<0xFC00::16-native>> -> write_non_finite(:neg_infinity, 8)
-        <<0x7C00::16-native>> -> write_non_finite(:infinity, 8)
-        _ -> write_non_finite(:nan, 8)
-      end
-    end
+  def write_binary(
+        %T{type: type, data: %Backend{ref: device_ref}} = tensor,
+        binary,
+        start_indices,
+        slice_shape
+      )
+      when is_tuple(slice_shape) do
+    binary = to_storage_binary(binary, type, device_ref)
+    EMLX.write_blob(device_ref, binary, start_indices, slice_shape)
+    tensor
   end
 
+  defp to_storage_binary(binary, {:f, 8}, _device_ref), do: binary
+
+  defp to_storage_binary(binary, type, device_ref),
+    do: maybe_modify_binary(binary, type, to_nx_type(EMLX.scalar_type(device_ref)))
+
+  defp maybe_modify_binary(binary, type, type), do: binary
+
   defp maybe_modify_binary(binary, {:f, 64}, {:f, 32}) do
     for <<float::64 <- binary>>, into: <<>> do
       case <<float::64>> do
@@ -142,52 +261,6 @@ defmodule EMLX.Backend do
     end
   end
 
-  defp maybe_modify_binary(binary, {:f, 32}, {:f, 64}) do
-    for <<float::32 <- binary>>, into: <<>> do
-      case <<float::32>> do
-        <<float::float-native-32>> -> <<float::float-native-size(64)>>
-        <<0xFF800000::32-native>> -> write_non_finite(:neg_infinity, 64)
-        <<0x7F800000::32-native>> -> write_non_finite(:infinity, 64)
-        _ -> write_non_finite(:nan, 64)
-      end
-    end
-  end
-
-  defp maybe_modify_binary(binary, {:u, size}, {:u, 8}) when size in [2, 4] do
-    for <<bits::integer-native-size(size) <- binary>>, into: <<>> do
-      <<bits::integer-native-size(8)>>
-    end
-  end
-
-  defp maybe_modify_binary(binary, {:u, 8}, {:u, size}) when size in [2, 4] do
-    for <<bits::integer-native-size(8) <- binary>>, into: <<>> do
-      <<bits::integer-native-size(size)>>
-    end
-  end
-
-  defp read_f8(<<0xFC::8-native>>), do: :neg_infinity
-  defp read_f8(<<0x7C::8-native>>), do: :infinity
-  defp read_f8(<<_sign::1, 31::5, mantissa::2>>) when mantissa != 0, do: :nan
-
-  defp read_f8(<<sign::1, exp::5, mantissa::2>>) do
-    float = :math.pow(2, exp - 15) * (1 + mantissa / 4)
-
-    case sign do
-      0 -> float
-      _ -> -float
-    end
-  end
-
-  if System.endianness() == :little do
-    def write_finite_f8(x) do
-      binary_part(<<x::float-native-16>>, 0, 1)
-    end
-  else
-    def write_finite_f8(x) do
-      binary_part(<<x::float-native-16>>, 1, 1)
-    end
-  end
-
   for size <- [8, 16, 32, 64] do
     def write_non_finite(data, unquote(size)) do
       case data do
@@ -335,6 +408,10 @@ defmodule EMLX.Backend do
   end
 
   if Application.compile_env(:emlx, :add_backend_on_inspect, true) do
+    defp maybe_add_signature(result, %T{data: %Backend{ref: nil, scalar: {device, _}}}) do
+      Inspect.Algebra.concat(["EMLX.Backend<#{device}>", Inspect.Algebra.line(), result])
+    end
+
     defp maybe_add_signature(result, %T{data: %Backend{ref: {device, ref}}}) do
       ~c"#Ref<" ++ rest = :erlang.ref_to_list(ref)
 
@@ -353,6 +430,119 @@ defmodule EMLX.Backend do
   defp needs_type_conversion?({:u, 8}, :bool), do: true
   defp needs_type_conversion?(_, _), do: false
 
+  @doc false
+  def mlx_type(type), do: to_mlx_type(type)
+
+  ## Containers
+
+  # Leaves stored as plain MLX arrays of their own type go through the
+  # bulk NIFs and are rebuilt without the checks of to_nx/2, since their
+  # shape and type are known. Packed and f8 leaves use the per-tensor ops.
+
+  @doc false
+  def tree_astype(container, type) do
+    type = Nx.Type.normalize!(type)
+
+    cast? = fn
+      %T{type: leaf_type} -> Nx.Type.float?(leaf_type) and leaf_type != type
+      _number -> false
+    end
+
+    bulk? = &(cast?.(&1) and plain?(&1) and plain_type?(type))
+    bulk = container |> tensor_leaves() |> Enum.filter(bulk?)
+    refs = Enum.map(bulk, &from_nx/1)
+
+    casts =
+      if refs == [] do
+        []
+      else
+        refs
+        |> EMLX.astype_all(to_mlx_type(type), merged_device(refs))
+        |> Enum.zip_with(Enum.zip(bulk, refs), fn ref, {leaf, {device, _}} ->
+          wrap({device, ref}, %{leaf | type: type})
+        end)
+      end
+
+    # The casts are in traversal order, so they are matched by position
+    {container, []} =
+      Nx.Defn.Composite.traverse(container, casts, fn leaf, casts ->
+        cond do
+          bulk?.(leaf) -> {hd(casts), tl(casts)}
+          cast?.(leaf) -> {Nx.as_type(leaf, type), casts}
+          true -> {leaf, casts}
+        end
+      end)
+
+    container
+  end
+
+  @doc false
+  def tree_transfer(container, device) do
+    leaves = tensor_leaves(container)
+    copies = tree_copy(leaves, device)
+    Enum.each(leaves, &Nx.backend_deallocate/1)
+
+    {container, []} =
+      Nx.Defn.Composite.traverse(container, copies, fn
+        %T{}, [copy | copies] -> {copy, copies}
+        number, copies -> {number, copies}
+      end)
+
+    container
+  end
+
+  @doc false
+  def tree_eval(container) do
+    refs = for leaf <- tensor_leaves(container), emlx_array?(leaf), do: leaf.data.ref
+
+    if refs != [], do: :ok = EMLX.eval_all(refs)
+    container
+  end
+
+  # The tensor leaves in traversal order. Number leaves are left out,
+  # and the traversals above pass them through unchanged.
+  defp tensor_leaves(container) do
+    container
+    |> Nx.Defn.Composite.reduce([], fn
+      %T{} = leaf, acc -> [leaf | acc]
+      _number, acc -> acc
+    end)
+    |> Enum.reverse()
+  end
+
+  # EMLX leaves become new handles to the same arrays tagged with
+  # device, other leaves are uploaded one by one
+  defp tree_copy(leaves, device) do
+    refs = for leaf <- leaves, emlx_array?(leaf), do: leaf.data.ref
+    shared = if refs == [], do: [], else: EMLX.share_all(refs)
+
+    {copies, []} =
+      Enum.map_reduce(leaves, shared, fn leaf, shared ->
+        if emlx_array?(leaf) do
+          {wrap({device, hd(shared)}, leaf), tl(shared)}
+        else
+          {Nx.backend_copy(leaf, {Backend, device: device}), shared}
+        end
+      end)
+
+    copies
+  end
+
+  defp emlx_array?(%T{data: %Backend{ref: {_, ref}}}), do: is_reference(ref)
+  defp emlx_array?(_), do: false
+
+  defp plain?(%T{type: type} = t), do: plain_type?(type) and emlx_array?(t)
+
+  defp plain_type?({:f, 8}), do: false
+  defp plain_type?({_, bits}), do: bits not in @packed_bits
+
+  defp merged_device(refs),
+    do: if(Enum.any?(refs, &match?({:gpu, _}, &1)), do: :gpu, else: :cpu)
+
+  defp wrap(device_ref, %T{type: type, shape: shape} = t),
+    do: %T{t | data: %Backend{ref: device_ref, shape: shape, type: type}}
+
+  # Sub-byte types map to the type they are unpacked into for computation
   defp to_mlx_type({:u, 2}), do: :uint8
   defp to_mlx_type({:u, 4}), do: :uint8
   defp to_mlx_type({:u, 8}), do: :uint8
@@ -365,15 +555,26 @@ defmodule EMLX.Backend do
   defp to_mlx_type({:s, 16}), do: :int16
   defp to_mlx_type({:s, 32}), do: :int32
   defp to_mlx_type({:s, 64}), do: :int64
+  # {:f, 8} is computed in float16, see from_nx/1
   defp to_mlx_type({:f, 8}), do: :float16
   defp to_mlx_type({:f, 16}), do: :float16
   defp to_mlx_type({:f, 32}), do: :float32
-  defp to_mlx_type({:f, 64}), do: :float32
+  # float64 is native on the CPU when MLX supports it. GPU tensors
+  # are kept in float32 by the NIFs, see check_shape_and_type!/3
+  defp to_mlx_type({:f, 64}),
+    do: if(EMLX.float64_supported?(), do: :float64, else: :float32)
+
   defp to_mlx_type({:bf, 16}), do: :bfloat16
   defp to_mlx_type({:c, 64}), do: :complex64
+  # MLX has no complex128 on any device
   defp to_mlx_type({:c, 128}), do: :complex64
   defp to_mlx_type(:bool), do: :bool
 
+  # to_blob converts while copying, so f64 tensors stored as f32
+  # on the GPU are widened in the NIF instead of in Elixir
+  defp to_blob_type({:f, 64}), do: :float64
+  defp to_blob_type(type), do: to_mlx_type(type)
+
   defp to_nx_type(:uint8), do: {:u, 8}
   defp to_nx_type(:uint16), do: {:u, 16}
   defp to_nx_type(:uint32), do: {:u, 32}
@@ -384,6 +585,7 @@ defmodule EMLX.Backend do
   defp to_nx_type(:int64), do: {:s, 64}
   defp to_nx_type(:float16), do: {:f, 16}
   defp to_nx_type(:float32), do: {:f, 32}
+  defp to_nx_type(:float64), do: {:f, 64}
   defp to_nx_type(:bfloat16), do: {:bf, 16}
   defp to_nx_type(:complex64), do: {:c, 64}
   defp to_nx_type(:bool), do: :bool
@@ -404,15 +606,6 @@ defmodule EMLX.Backend do
     end
 
     case {actual_type, expected_type} do
-      {{:s, 8}, {:s, qint}} when qint in [2, 4] ->
-        :ok
-
-      {{:u, 8}, {:u, qint}} when qint in [2, 4] ->
-        :ok
-
-      {{:f, 16}, {:f, 8}} ->
-        :ok
-
       {{:f, 32}, {:f, 64}} ->
         :ok
 
@@ -443,10 +636,16 @@ defmodule EMLX.Backend do
 
   @impl true
   def constant(%T{shape: {}, type: type} = out, scalar, backend_options) do
-    scalar
-    |> constant_serialize_scalar()
-    |> EMLX.scalar_tensor(to_mlx_type(type), device_option(backend_options))
-    |> to_nx(out)
+    scalar = constant_serialize_scalar(scalar)
+    device = device_option(backend_options)
+
+    if deferrable_scalar?(scalar, type) do
+      %T{out | data: %Backend{scalar: {device, scalar}, shape: {}, type: type}}
+    else
+      scalar
+      |> EMLX.scalar_tensor(to_mlx_type(type), device)
+      |> to_nx(out)
+    end
   end
 
   def constant(%T{shape: shape, type: type} = out, scalar, backend_options) do
@@ -462,16 +661,44 @@ defmodule EMLX.Backend do
   end
 
   def iota(%T{shape: shape, type: type} = out, nil, backend_options) do
-    EMLX.arange(
-      0,
-      Nx.size(shape),
-      1,
-      Nx.Type.integer?(type),
-      device_option(backend_options)
-    )
-    |> EMLX.astype(to_mlx_type(type))
-    |> EMLX.reshape(shape)
-    |> to_nx(out)
+    size = Nx.size(shape)
+
+    if size <= @max_mlx_dim do
+      EMLX.arange(0, size, 1, Nx.Type.integer?(type), device_option(backend_options))
+      |> EMLX.astype(to_mlx_type(type))
+      |> EMLX.reshape(shape)
+      |> to_nx(out)
+    else
+      out
+      |> flat_index(device_option(backend_options))
+      |> EMLX.astype(to_mlx_type(type))
+      |> to_nx(out)
+    end
+  end
+
+  # A flat arange cannot hold more than @max_mlx_dim elements, so larger
+  # iotas add up the per-axis indices scaled by their row-major strides
+  defp flat_index(%T{shape: shape}, device) do
+    {_, strides} =
+      shape
+      |> Tuple.to_list()
+      |> Enum.reverse()
+      |> Enum.reduce({1, []}, fn dim, {stride, strides} -> {stride * dim, [stride | strides]} end)
+
+    rank = tuple_size(shape)
+
+    strides
+    |> Enum.with_index()
+    |> Enum.map(fn {stride, axis} ->
+      dim = elem(shape, axis)
+
+      EMLX.arange(0, dim, 1, true, device)
+      |> EMLX.astype(:int64)
+      |> EMLX.multiply(stride)
+      |> EMLX.reshape(Tuple.duplicate(1, rank) |> put_elem(axis, dim))
+    end)
+    |> Enum.reduce(&EMLX.add(&2, &1))
+    |> EMLX.broadcast_to(shape)
   end
 
   @impl true
@@ -504,24 +731,13 @@ defmodule EMLX.Backend do
   for op <- ops do
     @impl true
     def unquote(op)(out, tensor, opts) do
-      axes = opts[:axes] || []
+      axes = opts[:axes] || Nx.axes(tensor)
       keep_axes = opts[:keep_axes] || false
 
-      # Calculate the expected output shape based on the input shape and axes
-      result =
-        tensor
-        |> from_nx()
-        |> EMLX.unquote(op)(axes, keep_axes)
-        |> EMLX.astype(to_mlx_type(out.type))
-
-      # Get the actual shape after summation
-      actual_shape = EMLX.shape(result)
-      # FIXME: MLX returns whatever the original type is, but Nx expects u8 -> u32
-      # scalar_type = EMLX.scalar_type(result)
-
-      # Create a new output tensor with the correct shape
-      %{out | shape: actual_shape}
-      |> then(&to_nx(result, &1))
+      tensor
+      |> from_nx()
+      |> EMLX.unquote(op)(axes, keep_axes, to_mlx_type(out.type))
+      |> to_nx(out)
     end
   end
 
@@ -673,6 +889,22 @@ defmodule EMLX.Backend do
     List.flatten([batch, spatial, channels])
   end
 
+  # transpose(transpose(t, first), second) as a single permutation
+  defp compose_permutations(first, second), do: Enum.map(second, &Enum.at(first, &1))
+
+  defp invert_permutation(permutation) do
+    permutation
+    |> Enum.with_index()
+    |> Enum.sort()
+    |> Enum.map(&elem(&1, 1))
+  end
+
+  defp maybe_transpose(t_mx, permutation) do
+    if permutation == Enum.to_list(0..(length(permutation) - 1)),
+      do: t_mx,
+      else: EMLX.transpose(t_mx, permutation)
+  end
+
   @impl true
   def conv(%T{type: {:c, _}}, input, kernel, opts) do
     # MLX doesn't support complex inputs,
@@ -730,27 +962,25 @@ defmodule EMLX.Backend do
       raise "MLX doesn't support batch group size"
     end
 
-    permute_channels_last =
-      Enum.to_list(0..(tuple_size(input.shape) - 1)) |> move_channels_last()
+    # MLX convolves channels-last. Each operand's permutations are composed
+    # into a single transpose, which disappears for channels-last layouts
+    # (input_permutation and output_permutation [0, rank - 1, 1, ...]).
+    input_layout = compose_permutations(input_permutation, move_channels_last(Nx.axes(input)))
+    kernel_layout = compose_permutations(kernel_permutation, move_channels_last(Nx.axes(kernel)))
 
     input_mx =
       from_nx(input)
       |> EMLX.astype(to_mlx_type(out.type))
-      |> EMLX.transpose(input_permutation)
-      |> EMLX.transpose(permute_channels_last)
-
-    permute_channels_last =
-      Enum.to_list(0..(tuple_size(kernel.shape) - 1)) |> move_channels_last()
+      |> maybe_transpose(input_layout)
 
     kernel_mx =
       from_nx(kernel)
       |> EMLX.astype(to_mlx_type(out.type))
-      |> EMLX.transpose(kernel_permutation)
-      |> EMLX.transpose(permute_channels_last)
+      |> maybe_transpose(kernel_layout)
 
     {padding_low, padding_high} = Enum.unzip(padding)
 
-    [batch | spatial_and_channels] = Enum.to_list(0..(tuple_size(out.shape) - 1))
+    [batch | spatial_and_channels] = Nx.axes(out)
 
     {channels, spatial} = List.pop_at(spatial_and_channels, -1)
 
@@ -759,24 +989,202 @@ defmodule EMLX.Backend do
     # The permutation that Nx.Shape expects is actually the reverse permutation
     # for the given config
     output_permutation =
-      output_permutation
+      compose_permutations(permute_channels_first, invert_permutation(output_permutation))
+
+    conv_mx =
+      if phased_conv?(input_dilation, strides, kernel_dilation) do
+        phased_conv(input_mx, kernel_mx, %{
+          input_shape: Enum.map(input_layout, &elem(input.shape, &1)),
+          kernel_shape: Enum.map(kernel_layout, &elem(kernel.shape, &1)),
+          strides: strides,
+          padding: padding,
+          kernel_dilation: kernel_dilation,
+          input_dilation: input_dilation,
+          feature_group_count: feature_group_count,
+          type: to_mlx_type(out.type)
+        })
+      else
+        EMLX.conv_general(
+          input_mx,
+          kernel_mx,
+          strides,
+          padding_low,
+          padding_high,
+          kernel_dilation,
+          input_dilation,
+          feature_group_count
+        )
+      end
+
+    conv_mx
+    |> maybe_transpose(output_permutation)
+    |> to_nx(out)
+  end
+
+  # Input dilation (transposed convolutions and input gradients) makes MLX
+  # multiply by the zeros it inserts between input elements. Along a
+  # dilated axis with stride and kernel dilation 1, the outputs with the
+  # same index modulo the dilation (a phase) only ever see every s-th
+  # kernel tap, so each phase is a plain convolution of the undilated
+  # input with a strided slice of the kernel. The phases are computed
+  # separately and interleaved back with stack and reshape, which skips
+  # the zeros entirely.
+  defp phased_conv?(input_dilation, strides, kernel_dilation) do
+    dims = Enum.zip([input_dilation, strides, kernel_dilation])
+
+    Enum.any?(dims, fn {dilation, _, _} -> dilation > 1 end) and
+      Enum.all?(dims, fn {dilation, stride, kernel_dilation} ->
+        dilation == 1 or (stride == 1 and kernel_dilation == 1)
+      end)
+  end
+
+  defp phased_conv(input_mx, kernel_mx, conv) do
+    [batch | input_spatial] = conv.input_shape
+    [out_channels | kernel_spatial] = conv.kernel_shape
+    {device, _} = input_mx
+
+    dims =
+      [
+        Enum.drop(input_spatial, -1),
+        Enum.drop(kernel_spatial, -1),
+        conv.input_dilation,
+        conv.padding,
+        conv.strides,
+        conv.kernel_dilation
+      ]
+      |> Enum.zip()
       |> Enum.with_index()
-      |> Enum.sort()
-      |> Enum.map(&elem(&1, 1))
+      |> Enum.map(fn {{size, kernel_size, dilation, {lo, hi}, stride, kernel_dilation}, axis} ->
+        if dilation > 1 do
+          out_size = (size - 1) * dilation + 1 + lo + hi - kernel_size + 1
+
+          %{
+            axis: axis + 1,
+            size: size,
+            kernel_size: kernel_size,
+            dilation: dilation,
+            padding: {lo, hi},
+            out_size: out_size,
+            phase_size: div(out_size + dilation - 1, dilation)
+          }
+        else
+          window = (kernel_size - 1) * kernel_dilation + 1
+          out_size = div(size + lo + hi - window, stride) + 1
+
+          %{
+            axis: axis + 1,
+            dilation: 1,
+            padding: {lo, hi},
+            stride: stride,
+            kernel_dilation: kernel_dilation,
+            out_size: out_size
+          }
+        end
+      end)
 
-    input_mx
-    |> EMLX.conv_general(
+    phased = Enum.filter(dims, &(&1.dilation > 1))
+
+    # Shape of the interleaved result once the given phased dims are done
+    shape = fn done ->
+      sizes =
+        Enum.map(dims, fn dim ->
+          if dim.dilation == 1 or dim.axis in done, do: dim.out_size, else: dim.phase_size
+        end)
+
+      [batch | sizes] ++ [out_channels]
+    end
+
+    leaf = fn phases ->
+      dims = Enum.map(dims, &phase_dim(&1, phases[&1.axis]))
+
+      if Enum.any?(dims, &(&1 == :zeros)) do
+        EMLX.full(0, List.to_tuple(shape.([])), conv.type, device)
+      else
+        phase_conv(input_mx, kernel_mx, dims, conv)
+      end
+    end
+
+    interleave_phases(phased, %{}, leaf, shape)
+  end
+
+  defp interleave_phases([], phases, leaf, _shape), do: leaf.(phases)
+
+  defp interleave_phases([dim | rest], phases, leaf, shape) do
+    phase_shape = shape.(Enum.map(rest, & &1.axis))
+    merged_shape = List.replace_at(phase_shape, dim.axis, dim.phase_size * dim.dilation)
+    out_shape = List.replace_at(phase_shape, dim.axis, dim.out_size)
+    zeros = Enum.map(out_shape, fn _ -> 0 end)
+    ones = Enum.map(out_shape, fn _ -> 1 end)
+
+    # Stacking the phases after the axis and merging the two puts output
+    # r + m * s at position m * s + r
+    0..(dim.dilation - 1)
+    |> Enum.map(&interleave_phases(rest, Map.put(phases, dim.axis, &1), leaf, shape))
+    |> EMLX.stack(dim.axis + 1)
+    |> EMLX.reshape(List.to_tuple(merged_shape))
+    |> EMLX.slice(zeros, out_shape, ones)
+  end
+
+  # The slice of the input and kernel, and the conv parameters, for one
+  # phase along one axis. Output m of phase r is output r + m * s of the
+  # dilated conv, which reads x[m + t + c] for kernel taps k0 + t * s.
+  defp phase_dim(%{dilation: 1} = dim, nil), do: dim
+
+  defp phase_dim(%{dilation: s, padding: {lo, _}} = dim, r) do
+    k0 = Integer.mod(lo - r, s)
+    taps = if dim.kernel_size > k0, do: div(dim.kernel_size - k0 + s - 1, s), else: 0
+    c = div(r + k0 - lo, s)
+    {start, stop} = {c, c + dim.phase_size + taps - 1}
+    {valid_start, valid_stop} = {max(start, 0), min(stop, dim.size)}
+
+    if taps == 0 or valid_start >= valid_stop do
+      :zeros
+    else
+      %{
+        axis: dim.axis,
+        input: {valid_start, valid_stop, 1},
+        kernel: {k0, dim.kernel_size, s},
+        padding: {valid_start - start, stop - valid_stop},
+        dilation: 1,
+        stride: 1,
+        kernel_dilation: 1
+      }
+    end
+  end
+
+  defp phase_conv(input_mx, kernel_mx, dims, conv) do
+    input_mx = slice_phase(input_mx, conv.input_shape, dims, :input)
+    kernel_mx = slice_phase(kernel_mx, conv.kernel_shape, dims, :kernel)
+
+    {padding_low, padding_high} = dims |> Enum.map(& &1.padding) |> Enum.unzip()
+
+    EMLX.conv_general(
+      input_mx,
       kernel_mx,
-      strides,
+      Enum.map(dims, & &1.stride),
       padding_low,
       padding_high,
-      kernel_dilation,
-      input_dilation,
-      feature_group_count
+      Enum.map(dims, & &1.kernel_dilation),
+      Enum.map(dims, fn _ -> 1 end),
+      conv.feature_group_count
     )
-    |> EMLX.transpose(permute_channels_first)
-    |> EMLX.transpose(output_permutation)
-    |> to_nx(out)
+  end
+
+  defp slice_phase(t_mx, shape, dims, key) do
+    slices = for %{^key => slice, axis: axis} <- dims, into: %{}, do: {axis, slice}
+
+    if slices == %{} do
+      t_mx
+    else
+      ranges = shape |> Enum.with_index(&Map.get(slices, &2, {0, &1, 1}))
+
+      EMLX.slice(
+        t_mx,
+        Enum.map(ranges, &elem(&1, 0)),
+        Enum.map(ranges, &elem(&1, 1)),
+        Enum.map(ranges, &elem(&1, 2))
+      )
+    end
   end
 
   defp dot_spec_to_einsum_spec(
@@ -857,36 +1265,121 @@ defmodule EMLX.Backend do
     computation_out_type =
       if Nx.Type.integer?(out_type), do: Nx.Type.to_floating(out_type), else: out_type
 
-    if left_batched_axes != [] or right_batched_axes != [] do
-      einsum_spec =
-        dot_spec_to_einsum_spec(
-          left.shape,
-          right.shape,
+    matmul =
+      not Nx.Type.complex?(computation_out_type) and
+        matmul_operands(
+          {left_mx, left.shape, left_axes, left_batched_axes},
+          {right_mx, right.shape, right_axes, right_batched_axes}
+        )
+
+    cond do
+      matmul ->
+        {left_mx, right_mx, shape} = matmul
+
+        left_mx
+        |> EMLX.matmul(right_mx, to_mlx_type(computation_out_type), to_mlx_type(out_type))
+        |> maybe_reshape(shape, out.shape)
+        |> to_nx(out)
+
+      left_batched_axes != [] or right_batched_axes != [] ->
+        einsum_spec =
+          dot_spec_to_einsum_spec(
+            left.shape,
+            right.shape,
+            left_axes,
+            left_batched_axes,
+            right_axes,
+            right_batched_axes
+          )
+
+        EMLX.einsum(
+          [
+            to_typed_ref(left_mx, left_type, computation_out_type),
+            to_typed_ref(right_mx, right_type, computation_out_type)
+          ],
+          einsum_spec
+        )
+        |> to_typed_ref(computation_out_type, out_type)
+        |> to_nx(out)
+
+      true ->
+        EMLX.tensordot(
+          to_typed_ref(left_mx, left_type, computation_out_type),
+          to_typed_ref(right_mx, right_type, computation_out_type),
           left_axes,
-          left_batched_axes,
-          right_axes,
-          right_batched_axes
+          right_axes
         )
+        |> to_typed_ref(computation_out_type, out_type)
+        |> to_nx(out)
+    end
+  end
 
-      EMLX.einsum(
-        to_typed_ref(left_mx, left_type, computation_out_type),
-        to_typed_ref(right_mx, right_type, computation_out_type),
-        einsum_spec
-      )
-      |> to_typed_ref(computation_out_type, out_type)
-      |> to_nx(out)
+  # Dots whose batch axes lead both operands and whose contracting axes
+  # are contiguous at either end of the remaining axes are matmuls over
+  # [batch..., m, k] x [batch..., k, n] views. Operands contracting on
+  # the other side are swapped in their last two axes, which MLX's
+  # matmul reads without a copy. Returns the operands and the product's
+  # shape, or false.
+  defp matmul_operands({left_mx, left_shape, left_axes, left_batch}, right) do
+    {right_mx, right_shape, right_axes, right_batch} = right
+    batch = Enum.to_list(0..(length(left_batch) - 1)//1)
+
+    with true <- left_batch == batch and right_batch == batch,
+         {left_side, left_free, k} <- matmul_side(left_shape, left_axes, batch),
+         {right_side, right_free, ^k} <- matmul_side(right_shape, right_axes, batch) do
+      batch_shape = Enum.map(batch, &elem(left_shape, &1))
+      {m, n} = {Enum.product(left_free), Enum.product(right_free)}
+
+      left_mx =
+        if left_side == :trailing do
+          maybe_reshape(left_mx, left_shape, List.to_tuple(batch_shape ++ [m, k]))
+        else
+          left_mx
+          |> maybe_reshape(left_shape, List.to_tuple(batch_shape ++ [k, m]))
+          |> swap_last_axes(length(batch) + 2)
+        end
+
+      right_mx =
+        if right_side == :leading do
+          maybe_reshape(right_mx, right_shape, List.to_tuple(batch_shape ++ [k, n]))
+        else
+          right_mx
+          |> maybe_reshape(right_shape, List.to_tuple(batch_shape ++ [n, k]))
+          |> swap_last_axes(length(batch) + 2)
+        end
+
+      {left_mx, right_mx, List.to_tuple(batch_shape ++ [m, n])}
     else
-      EMLX.tensordot(
-        to_typed_ref(left_mx, left_type, computation_out_type),
-        to_typed_ref(right_mx, right_type, computation_out_type),
-        left_axes,
-        right_axes
-      )
-      |> to_typed_ref(computation_out_type, out_type)
-      |> to_nx(out)
+      _ -> false
+    end
+  end
+
+  # Whether axes are the trailing axes or the ones right after the batch
+  # axes, with the free dimensions and the contracted size
+  defp matmul_side(shape, axes, batch) do
+    dims = Tuple.to_list(shape)
+    {rank, count, batch_rank} = {length(dims), length(axes), length(batch)}
+    k = axes |> Enum.map(&Enum.at(dims, &1)) |> Enum.product()
+
+    cond do
+      axes == Enum.to_list((rank - count)..(rank - 1)//1) ->
+        {:trailing, Enum.slice(dims, batch_rank..(rank - count - 1)//1), k}
+
+      axes == Enum.to_list(batch_rank..(batch_rank + count - 1)//1) ->
+        {:leading, Enum.drop(dims, batch_rank + count), k}
+
+      true ->
+        nil
     end
   end
 
+  defp swap_last_axes(t_mx, rank) do
+    EMLX.transpose(t_mx, Enum.to_list(0..(rank - 3)//1) ++ [rank - 1, rank - 2])
+  end
+
+  defp maybe_reshape(t_mx, shape, shape), do: t_mx
+  defp maybe_reshape(t_mx, _from, to), do: EMLX.reshape(t_mx, to)
+
   # Unary Ops
 
   ops =
@@ -972,9 +1465,9 @@ defmodule EMLX.Backend do
     t = from_nx(tensor)
 
     out_type = to_mlx_type(out.type)
-    {dev, _} = erf = EMLX.erf(t) |> EMLX.astype(out_type)
+    erf = EMLX.erf(t) |> EMLX.astype(out_type)
 
-    EMLX.scalar_tensor(1, out_type, dev)
+    1
     |> EMLX.subtract(erf)
     |> to_nx(out)
   end
@@ -986,12 +1479,9 @@ defmodule EMLX.Backend do
   for op <- ops do
     @impl true
     def unquote(op)(out, l, r) do
-      {left, right} = maybe_upcast(l, r)
-      {left_mx, right_mx} = maybe_broadcast_bin_args(out.shape, left, right)
-      result = EMLX.unquote(op)(left_mx, right_mx)
+      {left_mx, right_mx, compute_type} = bin_args(l, r)
 
-      result
-      |> EMLX.astype(to_mlx_type(out.type))
+      EMLX.unquote(op)(left_mx, right_mx, compute_type, to_mlx_type(out.type))
       |> to_nx(out)
     end
   end
@@ -1060,50 +1550,39 @@ defmodule EMLX.Backend do
   for op <- ops do
     @impl true
     def unquote(op)(out, l, r) do
-      {left, right} = maybe_upcast(l, r)
-      {left_mx, right_mx} = maybe_broadcast_bin_args(out.shape, left, right)
+      {left_mx, right_mx, compute_type} = bin_args(l, r)
 
-      EMLX.unquote(op)(left_mx, right_mx)
-      |> EMLX.astype(to_mlx_type(out.type))
+      EMLX.unquote(op)(left_mx, right_mx, compute_type, to_mlx_type(out.type))
       |> to_nx(out)
     end
   end
 
   @impl true
   def remainder(out, l, r) do
-    {left, right} = maybe_upcast(l, r)
-    {left_mx, right_mx} = maybe_broadcast_bin_args(out.shape, left, right)
-
-    {device, _} =
-      rem_mx =
-      EMLX.remainder(left_mx, right_mx)
-      |> EMLX.astype(to_mlx_type(out.type))
+    {left_mx, right_mx, compute_type} = bin_args(materialize(l), r)
+    out_type = to_mlx_type(out.type)
 
-    zero = EMLX.scalar_tensor(0, to_mlx_type(left.type), device)
+    rem_mx = EMLX.remainder(left_mx, right_mx, compute_type, out_type)
 
     left_mx
-    |> EMLX.less(zero)
-    |> EMLX.where(EMLX.subtract(rem_mx, right_mx), rem_mx)
+    |> EMLX.less(0)
+    |> EMLX.where(EMLX.subtract(rem_mx, right_mx, out_type, out_type), rem_mx)
     |> to_nx(out)
   end
 
   @impl true
   def min(out, l, r) do
-    {left, right} = maybe_upcast(l, r)
-    {left_mx, right_mx} = maybe_broadcast_bin_args(out.shape, left, right)
+    {left_mx, right_mx, compute_type} = bin_args(l, r)
 
-    EMLX.minimum(left_mx, right_mx)
-    |> EMLX.astype(to_mlx_type(out.type))
+    EMLX.minimum(left_mx, right_mx, compute_type, to_mlx_type(out.type))
     |> to_nx(out)
   end
 
   @impl true
   def max(out, l, r) do
-    {left, right} = maybe_upcast(l, r)
-    {left_mx, right_mx} = maybe_broadcast_bin_args(out.shape, left, right)
+    {left_mx, right_mx, compute_type} = bin_args(l, r)
 
-    EMLX.maximum(left_mx, right_mx)
-    |> EMLX.astype(to_mlx_type(out.type))
+    EMLX.maximum(left_mx, right_mx, compute_type, to_mlx_type(out.type))
     |> to_nx(out)
   end
 
@@ -1111,72 +1590,131 @@ defmodule EMLX.Backend do
   def clip(out, tensor, min, max) do
     tensor
     |> from_nx()
-    |> EMLX.clip(from_nx(min), from_nx(max))
+    |> EMLX.clip(from_nx_or_scalar(min), from_nx_or_scalar(max))
     |> to_nx(out)
   end
 
   @impl true
   def sort(out, tensor, opts) do
-    axis = opts[:axis]
-    asc? = opts[:direction] == :asc
-
-    t = tensor |> from_nx() |> EMLX.sort(axis)
-
-    if asc? do
-      to_nx(t, out)
-    else
-      t
-      |> to_nx(out)
-      |> Nx.reverse(axes: [axis])
-    end
+    tensor
+    |> from_nx()
+    |> EMLX.sort(opts[:axis], opts[:direction] == :desc)
+    |> to_nx(out)
   end
 
   @impl true
   def argsort(out, tensor, opts) do
-    axis = opts[:axis]
-    asc? = opts[:direction] == :asc
+    tensor
+    |> from_nx()
+    |> EMLX.argsort(opts[:axis], opts[:direction] == :desc)
+    |> EMLX.astype(to_mlx_type(out.type))
+    |> to_nx(out)
+  end
 
-    if asc? do
-      tensor
-      |> from_nx()
-      |> EMLX.argsort(axis)
-      |> EMLX.astype(to_mlx_type(out.type))
-      |> to_nx(out)
-    else
-      tensor
-      |> from_nx()
-      |> EMLX.negate()
-      |> EMLX.argsort(axis)
-      |> EMLX.astype(to_mlx_type(out.type))
-      |> to_nx(out)
-    end
+  # Partitions before sorting, so only the k selected entries are sorted
+  def top_k({values_out, indices_out}, tensor, opts) do
+    t_mx = from_nx(tensor)
+    indices_mx = EMLX.argtopk(t_mx, opts[:k], -1)
+
+    {
+      t_mx |> EMLX.take_along_axis(indices_mx, -1) |> to_nx(values_out),
+      indices_mx |> EMLX.astype(to_mlx_type(indices_out.type)) |> to_nx(indices_out)
+    }
   end
 
-  defp maybe_upcast(%T{type: t} = left, %T{type: t} = right),
-    do: {left, right}
+  # Optional callbacks for EMLX.Fast
+  def fast_softmax(out, tensor, opts) do
+    tensor
+    |> from_nx()
+    |> EMLX.astype(to_mlx_type(out.type))
+    |> EMLX.softmax(opts[:axes])
+    |> to_nx(out)
+  end
 
-  defp maybe_upcast(left, right) do
-    type = Nx.Type.merge(left.type, right.type)
-    {Nx.as_type(left, type), Nx.as_type(right, type)}
+  def fast_log_softmax(out, tensor, opts) do
+    tensor
+    |> from_nx()
+    |> EMLX.astype(to_mlx_type(out.type))
+    |> EMLX.log_softmax(opts[:axes])
+    |> to_nx(out)
   end
 
-  defp maybe_broadcast_bin_args(out_shape, l, r) do
-    l_mx =
-      case l.shape do
-        ^out_shape ->
-          from_nx(l)
+  def fast_logsumexp(out, tensor, opts) do
+    tensor
+    |> from_nx()
+    |> EMLX.astype(to_mlx_type(out.type))
+    |> EMLX.logsumexp(opts[:axes], opts[:keep_axes])
+    |> to_nx(out)
+  end
 
-        _ ->
-          l |> from_nx() |> EMLX.broadcast_to(out_shape)
-      end
+  # Broadcasting c over batch or left free axes would need the product
+  # reshaped first, so only biases that broadcast against the matmul
+  # result as it is take the addmm path
+  def fast_addmm(out, c, a, b, opts) do
+    {a_contract, b_contract} = opts[:contract_axes]
+    {a_batch, b_batch} = opts[:batch_axes]
 
-    r_mx =
-      case r.shape do
-        ^out_shape -> from_nx(r)
-        _ -> r |> from_nx() |> EMLX.broadcast_to(out_shape)
-      end
+    compute_type =
+      if Nx.Type.integer?(out.type), do: Nx.Type.to_floating(out.type), else: out.type
+
+    matmul =
+      not Nx.Type.complex?(compute_type) and
+        matmul_operands(
+          {from_nx(a), a.shape, a_contract, a_batch},
+          {from_nx(b), b.shape, b_contract, b_batch}
+        )
+
+    case matmul do
+      {a_mx, b_mx, shape} when shape == out.shape ->
+        c
+        |> from_nx()
+        |> EMLX.addmm(
+          a_mx,
+          b_mx,
+          opts[:alpha],
+          opts[:beta],
+          to_mlx_type(compute_type),
+          to_mlx_type(out.type)
+        )
+        |> to_nx(out)
+
+      _ ->
+        dot = Nx.dot(a, a_contract, a_batch, b, b_contract, b_batch)
+
+        c
+        |> Nx.multiply(opts[:beta])
+        |> Nx.add(Nx.multiply(dot, opts[:alpha]))
+        |> Nx.as_type(out.type)
+    end
+  end
+
+  def fast_gather_mm(out, a, b, lhs_indices, rhs_indices) do
+    compute_type =
+      if Nx.Type.integer?(out.type), do: Nx.Type.to_floating(out.type), else: out.type
+
+    a
+    |> from_nx()
+    |> EMLX.gather_mm(
+      from_nx(b),
+      from_nx(lhs_indices),
+      from_nx(rhs_indices),
+      to_mlx_type(compute_type),
+      to_mlx_type(out.type)
+    )
+    |> to_nx(out)
+  end
+
+  # The typed binary NIFs cast both operands to the merged type and
+  # broadcast them, so operands are passed as they are. When both are
+  # deferred scalars, the left one is built so the NIF gets their device
+  defp bin_args(%T{data: %Backend{ref: nil}} = left, %T{data: %Backend{ref: nil}} = right) do
+    compute_type = to_mlx_type(Nx.Type.merge(left.type, right.type))
+    {from_nx(left), from_nx_or_scalar(right), compute_type}
+  end
 
-    {l_mx, r_mx}
+  defp bin_args(left, right) do
+    compute_type = to_mlx_type(Nx.Type.merge(left.type, right.type))
+    {from_nx_or_scalar(left), from_nx_or_scalar(right), compute_type}
   end
 
   @impl true
@@ -1267,7 +1805,7 @@ defmodule EMLX.Backend do
 
     tensor
     |> from_nx()
-    |> EMLX.max(axes, keep_axes)
+    |> EMLX.max(axes, keep_axes, to_mlx_type(out.type))
     |> to_nx(out)
   end
 
@@ -1278,7 +1816,7 @@ defmodule EMLX.Backend do
 
     tensor
     |> from_nx()
-    |> EMLX.min(axes, keep_axes)
+    |> EMLX.min(axes, keep_axes, to_mlx_type(out.type))
     |> to_nx(out)
   end
 
@@ -1513,6 +2051,43 @@ defmodule EMLX.Backend do
     indexed_op(:scatter, out, target, indices, updates, opts)
   end
 
+  @doc false
+  def segment_reduce(out, data, segment_ids, op) do
+    indices = Nx.new_axis(segment_ids, -1)
+
+    case op do
+      :mean ->
+        sums = indexed_op(:scatter_add, out, zeros(out), indices, data, axes: [0])
+
+        counts_out = Nx.template({elem(out.shape, 0)}, out.type)
+        ones = Nx.broadcast(Nx.tensor(1, type: out.type, backend: Backend), segment_ids.shape)
+
+        counts =
+          counts_out
+          |> zeros()
+          |> then(&indexed_op(:scatter_add, counts_out, &1, indices, ones, axes: [0]))
+          |> Nx.max(1)
+          |> Nx.reshape(put_elem(Tuple.duplicate(1, tuple_size(out.shape)), 0, :auto))
+
+        sums |> Nx.divide(counts) |> Nx.as_type(out.type)
+
+      op ->
+        {nif_op, init} =
+          case op do
+            :sum -> {:scatter_add, Nx.tensor(0, type: out.type, backend: Backend)}
+            :prod -> {:scatter_prod, Nx.tensor(1, type: out.type, backend: Backend)}
+            :max -> {:scatter_max, Nx.Constants.min(out.type, backend: Backend)}
+            :min -> {:scatter_min, Nx.Constants.max(out.type, backend: Backend)}
+          end
+
+        target = Nx.broadcast(init, out.shape)
+        indexed_op(nif_op, out, target, indices, data, axes: [0])
+    end
+  end
+
+  defp zeros(%T{shape: shape, type: type}),
+    do: Nx.broadcast(Nx.tensor(0, type: type, backend: Backend), shape)
+
   defp indexed_op(nif_op, out, target, indices, updates, opts) do
     axes = opts[:axes] || Nx.axes(target)
     num_axes = Nx.axis_size(indices, -1)
@@ -1598,8 +2173,7 @@ defmodule EMLX.Backend do
           end
 
         EMLX.einsum(
-          a_inv_mx,
-          b_mx,
+          [a_inv_mx, b_mx],
           dot_spec_to_einsum_spec(
             EMLX.shape(a_inv_mx),
             EMLX.shape(b_mx),
@@ -1622,8 +2196,7 @@ defmodule EMLX.Backend do
           end
 
         EMLX.einsum(
-          b_mx,
-          a_inv_mx,
+          [b_mx, a_inv_mx],
           dot_spec_to_einsum_spec(
             EMLX.shape(b_mx),
             EMLX.shape(a_inv_mx),
@@ -1670,6 +2243,38 @@ defmodule EMLX.Backend do
   defp constant_serialize_scalar(scalar) when is_number(scalar), do: scalar
   defp constant_serialize_scalar(%Complex{} = c), do: {c.re, c.im}
 
+  # Deferred scalars are later built with the type of the tensor they
+  # are combined with, so only values that are exact in their own type
+  # are deferred
+  defp deferrable_scalar?({re, im}, {:c, bits}),
+    do: exact_float?(re, {:f, div(bits, 2)}) and exact_float?(im, {:f, div(bits, 2)})
+
+  defp deferrable_scalar?(scalar, {kind, _} = type) when is_number(scalar) and kind in [:f, :bf],
+    do: exact_float?(scalar * 1.0, type)
+
+  defp deferrable_scalar?(scalar, {:c, bits}) when is_float(scalar),
+    do: exact_float?(scalar, {:f, div(bits, 2)})
+
+  defp deferrable_scalar?(scalar, {:u, bits}) when is_integer(scalar),
+    do: scalar >= 0 and scalar < 2 ** bits
+
+  defp deferrable_scalar?(scalar, {:s, bits}) when is_integer(scalar),
+    do: scalar >= -(2 ** (bits - 1)) and scalar < 2 ** (bits - 1)
+
+  defp deferrable_scalar?(scalar, _type), do: is_integer(scalar)
+
+  # bf16 keeps the upper half of an f32
+  defp exact_float?(float, {:bf, 16}),
+    do: exact_float?(float, {:f, 32}) and match?(<<_::16, 0::16>>, <<float::float-32>>)
+
+  # Encoding raises for values out of the range of the type
+  defp exact_float?(float, {:f, bits}) do
+    <<rounded::float-size(bits)>> = <<float::float-size(bits)>>
+    rounded == float
+  rescue
+    ArgumentError -> false
+  end
+
   defp to_typed_ref(tensor, expected_type, expected_type),
     do: tensor
 
@@ -0,0 +1,155 @@
+defmodule EMLX.DataLoader do
+  @moduledoc """
+  Prefetching loader that turns a stream of binaries into `EMLX.Backend`
+  tensors.
+
+  Calling `Nx.from_binary/3` for each batch copies and casts it on the
+  process that runs the training step, so the device waits for every
+  upload. `stream/2` hands the binaries to a native worker thread
+  instead, which keeps up to `:prefetch` batches uploaded, cast and
+  evaluated ahead of the consumer:
+
+      "train.bin"
+      |> File.stream!(batch_size * 28 * 28)
+      |> EMLX.DataLoader.stream(shape: {batch_size, 28, 28}, type: :u8, as: :f32)
+      |> Enum.reduce(state, &train_step(&2, &1))
+
+  Batches come out in the order of the source. The binaries are queued
+  without being copied, and each one must hold at least the bytes of a
+  batch of `:shape` and `:type`.
+
+  The stream must be consumed by a single process, as the worker sends
+  the batches to the process that starts it.
+  """
+
+  @doc """
+  Streams `binaries` as tensors of `:shape`, uploaded in the background.
+
+  ## Options
+
+    * `:shape` - the shape of every batch. Required
+
+    * `:type` - the type of the binaries. Required
+
+    * `:as` - the type of the tensors. Defaults to `:type`
+
+    * `:prefetch` - how many batches to keep ready or in flight.
+      Defaults to `2`
+
+    * `:device` - `:cpu` or `:gpu`. Defaults to the device of the
+      default `EMLX.Backend`
+  """
+  def stream(binaries, opts) do
+    opts = Keyword.validate!(opts, [:shape, :type, :as, prefetch: 2, device: nil])
+
+    shape = opts[:shape] || raise ArgumentError, "the :shape option is required"
+    type = Nx.Type.normalize!(opts[:type] || raise(ArgumentError, "the :type option is required"))
+    out_type = Nx.Type.normalize!(opts[:as] || type)
+    prefetch = opts[:prefetch]
+
+    unless is_integer(prefetch) and prefetch > 0 do
+      raise ArgumentError,
+            "expected :prefetch to be a positive integer, got: #{inspect(prefetch)}"
+    end
+
+    for t <- [type, out_type], packed?(t) do
+      raise ArgumentError, "EMLX.DataLoader does not support type #{inspect(t)}"
+    end
+
+    config = %{
+      shape: shape,
+      type: type,
+      out_type: out_type,
+      prefetch: prefetch,
+      device: opts[:device] || default_device()
+    }
+
+    Stream.resource(fn -> start(binaries, config) end, &next/1, &stop/1)
+  end
+
+  defp start(binaries, config) do
+    tag = make_ref()
+
+    loader =
+      EMLX.loader_new(
+        config.shape,
+        EMLX.Backend.mlx_type(config.type),
+        EMLX.Backend.mlx_type(config.out_type),
+        tag,
+        config.device
+      )
+
+    # The source is pulled one binary at a time, as pushes free up
+    source = Enumerable.reduce(binaries, {:suspend, nil}, fn binary, _ -> {:suspend, binary} end)
+
+    fill(%{
+      loader: loader,
+      tag: tag,
+      source: source,
+      in_flight: 0,
+      prefetch: config.prefetch,
+      template: Nx.template(config.shape, config.out_type)
+    })
+  end
+
+  defp fill(%{in_flight: in_flight, prefetch: prefetch} = state) when in_flight >= prefetch,
+    do: state
+
+  defp fill(%{source: {:suspended, _, cont}} = state) do
+    case cont.({:cont, nil}) do
+      {:suspended, binary, _} = source ->
+        :ok = EMLX.loader_push(state.loader, binary)
+        fill(%{state | source: source, in_flight: state.in_flight + 1})
+
+      {done, _} when done in [:done, :halted] ->
+        %{state | source: :done}
+    end
+  end
+
+  defp fill(state), do: state
+
+  defp next(%{in_flight: 0} = state), do: {:halt, state}
+
+  defp next(%{tag: tag, loader: {device, _}} = state) do
+    receive do
+      {^tag, result} ->
+        ref = unwrap!(result)
+        state = fill(%{state | in_flight: state.in_flight - 1})
+        {[EMLX.Backend.to_nx({device, ref}, state.template)], state}
+    end
+  end
+
+  defp stop(%{tag: tag} = state) do
+    :ok = EMLX.loader_close(state.loader)
+
+    case state.source do
+      {:suspended, _, cont} -> cont.({:halt, nil})
+      _ -> :ok
+    end
+
+    # A closed loader sends nothing more, so any batch it sent is
+    # already in the mailbox
+    flush(tag)
+  end
+
+  defp flush(tag) do
+    receive do
+      {^tag, _} -> flush(tag)
+    after
+      0 -> :ok
+    end
+  end
+
+  defp unwrap!({:ok, ref}), do: ref
+  defp unwrap!({:error, reason}), do: raise(EMLX.NIFError, List.to_string(reason))
+
+  defp packed?({:f, 8}), do: true
+  defp packed?({_, bits}), do: bits < 8
+
+  defp default_device do
+    case Nx.default_backend() do
+      {EMLX.Backend, opts} -> opts[:device] || :cpu
+      _ -> :cpu
+    end
+  end
+end
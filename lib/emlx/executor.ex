@@ -0,0 +1,133 @@
+defmodule EMLX.Executor do
+  @moduledoc """
+  Native thread pool that evaluates `EMLX.Backend` tensors off the BEAM
+  schedulers.
+
+  EMLX operations are lazy, and they are evaluated by whichever NIF
+  first needs the data, on the scheduler thread of its caller. Many
+  concurrent callers therefore mean as many evaluations in parallel,
+  competing for the same cores and memory. `eval/2` queues the
+  evaluation for a fixed pool of native threads instead and waits for
+  the reply, so at most `:max_concurrency` evaluations run at once and
+  the calling scheduler stays free:
+
+      {:ok, logits} = EMLX.Executor.eval(model_output, priority: :interactive)
+
+  `Nx.Defn.jit/2` goes through the executor when given a `:priority`:
+
+      Nx.Defn.jit(&predict/2, compiler: EMLX, priority: :batch)
+
+  ## Priorities
+
+  Submissions are `:interactive` or `:batch`. Threads always take
+  interactive work first, so a backlog of batch jobs does not delay
+  latency sensitive requests.
+
+  ## Backpressure
+
+  When `:max_queue` submissions are already waiting, `eval/2` returns
+  `{:error, :overloaded}` right away instead of queueing, so callers can
+  shed load or retry rather than wait behind an ever longer queue.
+
+  ## Telemetry
+
+    * `[:emlx, :executor, :eval]` - emitted after each evaluation.
+      Measurements are the `:queue_depth` at submission, and the
+      `:queue_time` and `:duration` in native time units
+
+    * `[:emlx, :executor, :overload]` - emitted when a submission is
+      rejected, with the `:queue_depth` as measurement
+
+  Both have the `:priority` as metadata.
+  """
+
+  @priorities [:interactive, :batch]
+
+  @doc """
+  Evaluates every `EMLX.Backend` tensor of the `Nx.Container` on the
+  executor and returns `{:ok, container}` once they are computed, or
+  `{:error, :overloaded}` when the queue is full.
+
+  ## Options
+
+    * `:priority` - `:interactive` (the default) or `:batch`
+  """
+  def eval(container, opts \\ []) do
+    opts = Keyword.validate!(opts, priority: :interactive)
+    priority = opts[:priority]
+
+    unless priority in @priorities do
+      raise ArgumentError,
+            "expected :priority to be one of #{inspect(@priorities)}, got: #{inspect(priority)}"
+    end
+
+    refs =
+      for %Nx.Tensor{data: %EMLX.Backend{ref: {_, _} = ref}} <-
+            Nx.Defn.Composite.flatten_list([container]),
+          do: ref
+
+    if refs == [] do
+      {:ok, container}
+    else
+      submit(refs, priority, container)
+    end
+  end
+
+  defp submit(refs, priority, container) do
+    tag = make_ref()
+    metadata = %{priority: priority}
+
+    case EMLX.executor_submit(refs, priority == :interactive, tag) do
+      {:queued, depth} ->
+        receive do
+          {^tag, result, queue_us, run_us} ->
+            :telemetry.execute(
+              [:emlx, :executor, :eval],
+              %{queue_depth: depth, queue_time: native(queue_us), duration: native(run_us)},
+              metadata
+            )
+
+            case result do
+              :ok -> {:ok, container}
+              {:error, reason} -> raise EMLX.NIFError, List.to_string(reason)
+            end
+        end
+
+      {:overloaded, depth} ->
+        :telemetry.execute([:emlx, :executor, :overload], %{queue_depth: depth}, metadata)
+        {:error, :overloaded}
+    end
+  end
+
+  defp native(us), do: System.convert_time_unit(us, :microsecond, :native)
+
+  @doc """
+  Sets the executor limits, which apply to the whole VM.
+
+  ## Options
+
+    * `:max_concurrency` - how many evaluations run at once. Defaults
+      to `2`
+
+    * `:max_queue` - how many submissions may wait before `eval/2`
+      reports overload. Defaults to `256`
+  """
+  def configure(opts) do
+    current = stats()
+
+    opts =
+      Keyword.validate!(opts,
+        max_concurrency: current.max_concurrency,
+        max_queue: current.max_queue
+      )
+
+    EMLX.executor_configure(opts[:max_concurrency], opts[:max_queue])
+  end
+
+  @doc """
+  Returns a map with the number of `:interactive` and `:batch`
+  submissions waiting, the number `:running` and `:completed`, and the
+  current `:max_concurrency` and `:max_queue`.
+  """
+  def stats, do: EMLX.executor_stats()
+end
@@ -0,0 +1,480 @@
+defmodule EMLX.Fast do
+  @moduledoc """
+  Fused primitives that run as a single MLX kernel.
+
+  Each function works on any backend and inside `defn`. With
+  `EMLX.Backend` it maps to one MLX call, elsewhere it falls back to
+  the equivalent Nx operations.
+
+  The `EMLX` compiler also replaces the usual Nx formulations of these
+  functions with them, so existing code gets the fused kernels without
+  changes. The recognized patterns, with `m = reduce_max(x, keep_axes: true)`
+  (optionally wrapped in `stop_grad`), are:
+
+    * `exp(x - m) / sum(exp(x - m), keep_axes: true)` as `softmax/2`
+    * `(x - m) - log(sum(exp(x - m), keep_axes: true))` as `log_softmax/2`
+    * `m + log(sum(exp(x - m), keep_axes: true))` and
+      `log(sum(exp(x)))` as `logsumexp/2`
+    * `dot(a, b) + c` as `addmm/4`
+
+  Only floating point inputs whose result keeps the input type are
+  rewritten.
+
+  Convolutions are also rewritten to produce channels-last outputs, the
+  layout MLX convolves in, followed by a transpose back to the requested
+  layout. That transpose is moved past elementwise ops, such as bias
+  additions and activations, and transposes feeding a convolution are
+  folded into its input and kernel permutations, so chains of
+  convolutions pass channels-last tensors to each other without
+  transposing in between. Models that
+  want no transposes at all can use channels-last inputs and kernels
+  through the `:input_permutation`, `:kernel_permutation` and
+  `:output_permutation` options of `Nx.conv/3`.
+  """
+
+  alias Nx.Tensor, as: T
+  alias Nx.Defn.Expr
+
+  @doc """
+  Softmax over `:axes` (defaults to the last axis).
+
+  Half precision inputs accumulate in float32.
+  """
+  def softmax(tensor, opts \\ []) do
+    {tensor, axes} = normalize(tensor, opts)
+    out = Nx.template(tensor.shape, Nx.Type.to_floating(tensor.type), names: tensor.names)
+    Nx.Shared.optional(:fast_softmax, [tensor, [axes: axes]], out, &softmax_fallback/2)
+  end
+
+  @doc """
+  Log-softmax over `:axes` (defaults to the last axis).
+  """
+  def log_softmax(tensor, opts \\ []) do
+    {tensor, axes} = normalize(tensor, opts)
+    out = Nx.template(tensor.shape, Nx.Type.to_floating(tensor.type), names: tensor.names)
+    Nx.Shared.optional(:fast_log_softmax, [tensor, [axes: axes]], out, &log_softmax_fallback/2)
+  end
+
+  @doc """
+  Numerically stable `log(sum(exp(tensor)))` over `:axes` (defaults to
+  the last axis). Pass `keep_axes: true` to keep the reduced axes.
+  """
+  def logsumexp(tensor, opts \\ []) do
+    keep_axes = Keyword.get(opts, :keep_axes, false)
+    {tensor, axes} = normalize(tensor, Keyword.delete(opts, :keep_axes))
+
+    {shape, names} =
+      tensor.shape
+      |> Tuple.to_list()
+      |> Enum.zip(tensor.names)
+      |> Enum.with_index()
+      |> Enum.flat_map(fn {{dim, name}, axis} ->
+        cond do
+          axis not in axes -> [{dim, name}]
+          keep_axes -> [{1, name}]
+          true -> []
+        end
+      end)
+      |> Enum.unzip()
+
+    out = Nx.template(List.to_tuple(shape), Nx.Type.to_floating(tensor.type), names: names)
+
+    Nx.Shared.optional(
+      :fast_logsumexp,
+      [tensor, [axes: axes, keep_axes: keep_axes]],
+      out,
+      &logsumexp_fallback/2
+    )
+  end
+
+  @doc """
+  `beta * c + alpha * dot(a, b)` as a single matrix multiplication that
+  accumulates into `c`.
+
+  ## Options
+
+    * `:alpha` and `:beta` - the scale factors. Defaults to `1.0`
+
+    * `:contract_axes` and `:batch_axes` - `{a_axes, b_axes}` as in
+      `Nx.dot/6`. Default to the last axis of `a` and the second to last
+      axis of `b` (its only axis when it is a vector), with no batch axes,
+      as in `Nx.dot/2`
+  """
+  def addmm(c, a, b, opts \\ []) do
+    [c, a, b] = Enum.map([c, a, b], &Nx.to_tensor/1)
+
+    opts =
+      Keyword.validate!(opts,
+        alpha: 1.0,
+        beta: 1.0,
+        contract_axes: {[Nx.rank(a) - 1], [max(Nx.rank(b) - 2, 0)]},
+        batch_axes: {[], []}
+      )
+
+    {a_contract, b_contract} = opts[:contract_axes]
+    {a_batch, b_batch} = opts[:batch_axes]
+
+    dot_shape =
+      Enum.map(a_batch, &elem(a.shape, &1)) ++
+        free_dims(a, a_contract ++ a_batch) ++ free_dims(b, b_contract ++ b_batch)
+
+    type = Nx.Type.merge(Nx.Type.merge(a.type, b.type), c.type)
+    out = Nx.template(broadcast_shapes(Tuple.to_list(c.shape), dot_shape), type)
+    opts = Keyword.merge(opts, alpha: opts[:alpha] * 1.0, beta: opts[:beta] * 1.0)
+
+    Nx.Shared.optional(:fast_addmm, [c, a, b, opts], out, &addmm_fallback/4)
+  end
+
+  @doc """
+  Multiplies each matrix of `a` by a matrix of `b` picked by index, as in
+  mixture-of-experts layers where every token goes through the weights
+  of its selected expert.
+
+  `a` has shape `{..., m, k}` and `b` has shape `{..., k, n}`. The
+  leading axes of each are flattened into a list of matrices, and the
+  result is `a_matrices[lhs_indices] . b_matrices[rhs_indices]`, with
+  the index tensors broadcast against each other. Its shape is the
+  broadcast index shape followed by `{m, n}`.
+
+      # x: {tokens, 1, hidden}, experts: {num_experts, hidden, out},
+      # assignment: {tokens} integer tensor
+      EMLX.Fast.gather_mm(x, experts, rhs_indices: assignment)
+
+  With `EMLX.Backend` this is one MLX kernel instead of a take and a
+  dot per expert.
+
+  ## Options
+
+    * `:lhs_indices` and `:rhs_indices` - integer tensors of matrix
+      indices. Default to every matrix of the operand, in order
+  """
+  def gather_mm(a, b, opts \\ []) do
+    opts = Keyword.validate!(opts, [:lhs_indices, :rhs_indices])
+    [a, b] = Enum.map([a, b], &Nx.to_tensor/1)
+
+    {a_batch, [m, _k]} = a.shape |> Tuple.to_list() |> Enum.split(-2)
+    {b_batch, [_k, n]} = b.shape |> Tuple.to_list() |> Enum.split(-2)
+
+    lhs = matrix_indices(opts[:lhs_indices], a_batch)
+    rhs = matrix_indices(opts[:rhs_indices], b_batch)
+
+    batch = broadcast_shapes(Tuple.to_list(lhs.shape), Tuple.to_list(rhs.shape))
+    shape = List.to_tuple(Tuple.to_list(batch) ++ [m, n])
+    out = Nx.template(shape, Nx.Type.merge(a.type, b.type))
+
+    Nx.Shared.optional(:fast_gather_mm, [a, b, lhs, rhs], out, &gather_mm_fallback/4)
+  end
+
+  defp matrix_indices(nil, batch), do: Nx.iota(List.to_tuple(batch), type: :u32)
+  defp matrix_indices(indices, _batch), do: Nx.to_tensor(indices)
+
+  defp free_dims(tensor, axes) do
+    for {dim, axis} <- Enum.with_index(Tuple.to_list(tensor.shape)), axis not in axes, do: dim
+  end
+
+  defp broadcast_shapes(left, right) do
+    rank = max(length(left), length(right))
+    pad = &(List.duplicate(1, rank - length(&1)) ++ &1)
+    Enum.zip_with(pad.(left), pad.(right), &max/2) |> List.to_tuple()
+  end
+
+  defp normalize(tensor, opts) do
+    opts = Keyword.validate!(opts, axes: [-1])
+    tensor = Nx.to_tensor(tensor)
+    {tensor, Enum.map(opts[:axes], &Nx.axis_index(tensor, &1))}
+  end
+
+  defp softmax_fallback(tensor, opts) do
+    exp = Nx.exp(shift(tensor, opts[:axes]))
+    Nx.divide(exp, Nx.sum(exp, axes: opts[:axes], keep_axes: true))
+  end
+
+  defp log_softmax_fallback(tensor, opts) do
+    shifted = shift(tensor, opts[:axes])
+    Nx.subtract(shifted, Nx.log(Nx.sum(Nx.exp(shifted), axes: opts[:axes], keep_axes: true)))
+  end
+
+  defp logsumexp_fallback(tensor, opts) do
+    max = tensor |> Nx.reduce_max(axes: opts[:axes], keep_axes: true) |> Nx.stop_grad()
+    sum = tensor |> Nx.subtract(max) |> Nx.exp() |> Nx.sum(axes: opts[:axes], keep_axes: true)
+    result = Nx.add(max, Nx.log(sum))
+
+    if opts[:keep_axes], do: result, else: Nx.squeeze(result, axes: opts[:axes])
+  end
+
+  defp addmm_fallback(c, a, b, opts) do
+    {a_contract, b_contract} = opts[:contract_axes]
+    {a_batch, b_batch} = opts[:batch_axes]
+    dot = Nx.dot(a, a_contract, a_batch, b, b_contract, b_batch)
+
+    Nx.add(scale(c, opts[:beta]), scale(dot, opts[:alpha]))
+  end
+
+  defp gather_mm_fallback(a, b, lhs, rhs) do
+    batch = broadcast_shapes(Tuple.to_list(lhs.shape), Tuple.to_list(rhs.shape))
+    batch_axes = Enum.to_list(0..(tuple_size(batch) - 1)//1)
+
+    a = take_matrices(a, Nx.broadcast(lhs, batch))
+    b = take_matrices(b, Nx.broadcast(rhs, batch))
+
+    Nx.dot(a, [tuple_size(batch) + 1], batch_axes, b, [tuple_size(batch)], batch_axes)
+  end
+
+  defp take_matrices(tensor, indices) do
+    [rows, cols] = tensor.shape |> Tuple.to_list() |> Enum.take(-2)
+    tensor |> Nx.reshape({:auto, rows, cols}) |> Nx.take(indices, axis: 0)
+  end
+
+  defp scale(tensor, factor) when factor == 1, do: tensor
+  defp scale(tensor, factor), do: Nx.multiply(tensor, factor)
+
+  defp shift(tensor, axes) do
+    Nx.subtract(tensor, Nx.stop_grad(Nx.reduce_max(tensor, axes: axes, keep_axes: true)))
+  end
+
+  ## Rewriting
+
+  @doc false
+  # Called by EMLX.__compile__/4 on the traced expression. Matching is
+  # top-down, so the outermost pattern wins, and only the current scope
+  # is rewritten (not the bodies of while loops, conds or functions).
+  def rewrite(outputs) do
+    {outputs, _cache} = Nx.Defn.Composite.traverse(outputs, %{}, &rewrite/2)
+    outputs
+  end
+
+  defp rewrite(%T{data: %Expr{id: id}} = t, cache) do
+    case cache do
+      %{^id => rewritten} ->
+        {rewritten, cache}
+
+      %{} ->
+        {rewritten, cache} =
+          case fuse(t) do
+            {fun, args, opts} ->
+              {args, cache} = Enum.map_reduce(args, cache, &rewrite/2)
+              {apply(__MODULE__, fun, args ++ [opts]), cache}
+
+            nil ->
+              {args, cache} = Nx.Defn.Tree.apply_args(t, cache, &rewrite/2)
+              {channels_last(put_in(t.data.args, args)), cache}
+          end
+
+        {rewritten, Map.put(cache, id, rewritten)}
+    end
+  end
+
+  defp rewrite(other, cache), do: {other, cache}
+
+  defp fuse(%T{type: {kind, _} = type} = t) when kind in [:f, :bf] do
+    case match(t) do
+      {_fun, args, _opts} = fused -> if Enum.all?(args, &(&1.type == type)), do: fused
+      nil -> nil
+    end
+  end
+
+  defp fuse(_t), do: nil
+
+  # exp(x - m) / sum(exp(x - m))
+  defp match(%T{data: %Expr{op: :divide, args: [exp, sum]}}) do
+    with {:sum, [exp2, opts]} <- op(sum),
+         true <- same?(exp, exp2) and opts[:keep_axes],
+         {:exp, [shifted]} <- op(exp),
+         {x, _max, axes} <- shifted(shifted),
+         true <- axes == reduced_axes(x, opts) do
+      {:softmax, [x], axes: axes}
+    else
+      _ -> nil
+    end
+  end
+
+  # (x - m) - log(sum(exp(x - m)))
+  defp match(%T{data: %Expr{op: :subtract, args: [shifted, log]}}) do
+    with {x, _max, axes} <- shifted(shifted),
+         {:log, [sum]} <- op(log),
+         {:sum, [exp, opts]} <- op(sum),
+         true <- opts[:keep_axes] and axes == reduced_axes(x, opts),
+         {:exp, [shifted2]} <- op(exp),
+         true <- same?(shifted, shifted2) do
+      {:log_softmax, [x], axes: axes}
+    else
+      _ -> nil
+    end
+  end
+
+  defp match(%T{data: %Expr{op: :add, args: [left, right]}}) do
+    match_logsumexp(left, right) || match_addmm(left, right) || match_addmm(right, left)
+  end
+
+  # log(sum(exp(x)))
+  defp match(%T{data: %Expr{op: :log, args: [sum]}}) do
+    with {:sum, [exp, opts]} <- op(sum),
+         {:exp, [x]} <- op(exp) do
+      {:logsumexp, [x], axes: reduced_axes(x, opts), keep_axes: opts[:keep_axes]}
+    else
+      _ -> nil
+    end
+  end
+
+  defp match(_), do: nil
+
+  # m + log(sum(exp(x - m)))
+  defp match_logsumexp(max, log) do
+    with {:log, [sum]} <- op(log),
+         {:sum, [exp, opts]} <- op(sum),
+         {:exp, [shifted]} <- op(exp),
+         {x, max2, axes} <- shifted(shifted),
+         true <- same?(max, max2) and opts[:keep_axes] and axes == reduced_axes(x, opts) do
+      {:logsumexp, [x], axes: axes, keep_axes: true}
+    else
+      _ -> nil
+    end
+  end
+
+  # dot(a, b) + c
+  defp match_addmm(dot, c) do
+    case op(dot) do
+      {:dot, [a, a_contract, a_batch, b, b_contract, b_batch]} ->
+        {:addmm, [c, a, b],
+         contract_axes: {a_contract, b_contract}, batch_axes: {a_batch, b_batch}}
+
+      _ ->
+        nil
+    end
+  end
+
+  # x - reduce_max(x, keep_axes: true), returns {x, max, axes}
+  defp shifted(t) do
+    with {:subtract, [x, max]} <- op(t),
+         {:reduce_max, [x2, opts]} <- op(unwrap_stop_grad(max)),
+         true <- same?(x, x2) and opts[:keep_axes] do
+      {x, max, reduced_axes(x, opts)}
+    else
+      _ -> nil
+    end
+  end
+
+  defp unwrap_stop_grad(%T{data: %Expr{op: :metadata, args: [expr, %{stop_grad: true}]}}),
+    do: expr
+
+  defp unwrap_stop_grad(t), do: t
+
+  defp op(%T{data: %Expr{op: op, args: args}}), do: {op, args}
+  defp op(_), do: nil
+
+  defp same?(%T{data: %Expr{id: id}}, %T{data: %Expr{id: id}}), do: true
+  defp same?(_, _), do: false
+
+  defp reduced_axes(x, opts), do: Enum.sort(opts[:axes] || Nx.axes(x))
+
+  ## Convolution layout
+
+  @unary_ops ~w(abs negate exp expm1 log log1p sigmoid tanh sqrt rsqrt erf sin cos)a
+  @binary_ops [:add, :subtract, :multiply, :divide, :max, :min, :pow]
+
+  # Rewritten bottom-up, after the operands, so a transpose produced by
+  # rewriting the previous convolution is folded into this one
+  defp channels_last(%T{type: {kind, _}, data: %Expr{op: :conv, args: args}} = t)
+       when kind != :c do
+    [input, kernel, opts] = args
+
+    if opts[:batch_group_size] == 1 do
+      {input, input_permutation} = fold_transpose(input, opts[:input_permutation])
+      {kernel, kernel_permutation} = fold_transpose(kernel, opts[:kernel_permutation])
+
+      # As output_permutation, this means the conv output is laid out as
+      # [batch, spatial..., channels]
+      rank = tuple_size(t.shape)
+      last = [0, rank - 1 | Enum.to_list(1..(rank - 2)//1)]
+      back = compose(last, invert(opts[:output_permutation] || Nx.axes(t)))
+
+      opts =
+        Keyword.merge(opts,
+          input_permutation: input_permutation,
+          kernel_permutation: kernel_permutation,
+          output_permutation: last
+        )
+
+      input
+      |> Nx.conv(kernel, opts)
+      |> Nx.transpose(axes: back)
+    else
+      t
+    end
+  end
+
+  # op(transpose(x)) as transpose(op(x)), so the transpose reaches the
+  # next convolution. Broadcast operands of binary ops, such as a bias,
+  # are permuted instead, which is cheap as they are small.
+  defp channels_last(%T{data: %Expr{op: op, args: [arg]}} = t) when op in @unary_ops do
+    case op(arg) do
+      {:transpose, [x, axes]} -> Nx |> apply(op, [x]) |> Nx.transpose(axes: axes)
+      _ -> t
+    end
+  end
+
+  defp channels_last(%T{shape: shape, data: %Expr{op: op, args: [left, right]}} = t)
+       when op in @binary_ops do
+    with {:ok, axes} <- transposed_axes([left, right], shape),
+         {:ok, left} <- unpermute(left, axes, shape),
+         {:ok, right} <- unpermute(right, axes, shape) do
+      Nx |> apply(op, [left, right]) |> Nx.transpose(axes: axes)
+    else
+      _ -> t
+    end
+  end
+
+  defp channels_last(t), do: t
+
+  # The permutation of the first operand that is a transpose of the
+  # whole result
+  defp transposed_axes(operands, shape) do
+    Enum.find_value(operands, :error, fn operand ->
+      case op(operand) do
+        {:transpose, [_x, axes]} when operand.shape == shape -> {:ok, axes}
+        _ -> nil
+      end
+    end)
+  end
+
+  # The operand laid out like the input of the transpose by axes
+  defp unpermute(t, axes, shape) do
+    rank = tuple_size(shape)
+
+    case op(t) do
+      {:transpose, [x, ^axes]} ->
+        {:ok, x}
+
+      _ when tuple_size(t.shape) == 0 ->
+        {:ok, t}
+
+      _ ->
+        if Nx.size(t) < Nx.size(shape) do
+          ones = List.duplicate(1, rank - tuple_size(t.shape))
+          full = List.to_tuple(ones ++ Tuple.to_list(t.shape))
+          {:ok, t |> Nx.reshape(full) |> Nx.transpose(axes: invert(axes))}
+        else
+          :error
+        end
+    end
+  end
+
+  defp fold_transpose(t, permutation) do
+    permutation = permutation || Nx.axes(t)
+
+    case op(t) do
+      {:transpose, [x, axes]} -> {x, compose(axes, permutation)}
+      _ -> {t, permutation}
+    end
+  end
+
+  # transpose(transpose(t, first), second) as a single permutation
+  defp compose(first, second), do: Enum.map(second, &Enum.at(first, &1))
+
+  defp invert(permutation) do
+    permutation
+    |> Enum.with_index()
+    |> Enum.sort()
+    |> Enum.map(&elem(&1, 1))
+  end
+end
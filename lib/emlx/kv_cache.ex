@@ -0,0 +1,122 @@
+defmodule EMLX.KVCache do
+  @moduledoc """
+  Preallocated key/value cache for autoregressive decoding.
+
+  Growing the cache with `Nx.concatenate/2` or `Nx.put_slice/3` copies
+  every previous token on each step. `EMLX.KVCache` instead allocates
+  one key and one value buffer per layer up front, with `max_len` slots
+  along the second to last axis, and writes new steps into them in place.
+
+      cache = EMLX.KVCache.new(num_layers, {heads, max_len, head_dim}, type: :f16)
+
+      # per layer, per decoding step, with keys and values of shape
+      # {heads, steps, head_dim}
+      EMLX.KVCache.append(cache, layer, keys, values)
+      attention(query, EMLX.KVCache.keys(cache, layer), EMLX.KVCache.values(cache, layer))
+
+  `keys/2` and `values/2` return views of the filled part of the buffers
+  without copying. A view shares memory with the cache, so the next
+  `append/4` on its layer deallocates it to keep the write in place, and
+  using it afterwards raises. Anything still holding the buffer when
+  `append/4` runs costs one copy of the whole buffer instead: this is
+  the case for computations built on a view but not yet evaluated, and
+  for `Nx.backend_copy/2` to `EMLX.Backend`, which shares the array
+  under a new handle. To keep a view across steps without that cost,
+  copy it out of MLX, for example with
+  `Nx.backend_copy(view, Nx.BinaryBackend)`.
+
+  The cache is mutable: `append/4` and `reset/1` change it for everyone
+  holding it.
+
+  ## Ring buffers
+
+  With `mode: :ring` the cache keeps the last `max_len` steps of each
+  layer, as in sliding window attention. Once full, new steps overwrite
+  the oldest ones and the views cover the whole buffer in storage
+  order, not in time order, which attention without positional masking
+  does not depend on. Without it, appending past `max_len` raises.
+  """
+
+  @enforce_keys [:ref, :layers, :shape, :type, :mode]
+  defstruct [:ref, :layers, :shape, :type, :mode]
+
+  @doc """
+  Allocates a cache with `layers` key and value buffers of `shape`,
+  whose second to last axis is the maximum length.
+
+  ## Options
+
+    * `:type` - the buffer type. Defaults to `{:f, 32}`
+
+    * `:mode` - `:linear` (the default) or `:ring`
+
+    * `:device` - `:cpu` or `:gpu`. Defaults to the device of the
+      default `EMLX.Backend`
+  """
+  def new(layers, shape, opts \\ [])
+      when is_integer(layers) and layers > 0 and is_tuple(shape) and tuple_size(shape) >= 2 do
+    opts = Keyword.validate!(opts, type: {:f, 32}, mode: :linear, device: nil)
+    type = Nx.Type.normalize!(opts[:type])
+
+    unless opts[:mode] in [:linear, :ring] do
+      raise ArgumentError, "expected :mode to be :linear or :ring, got: #{inspect(opts[:mode])}"
+    end
+
+    device = opts[:device] || default_device()
+
+    mlx_type = EMLX.Backend.mlx_type(type)
+    ref = EMLX.kv_cache_new(layers, shape, mlx_type, opts[:mode] == :ring, device)
+    %__MODULE__{ref: ref, layers: layers, shape: shape, type: type, mode: opts[:mode]}
+  end
+
+  @doc """
+  Writes `keys` and `values` after the steps already stored in `layer`.
+
+  Both have the cache's rank, with the new steps along the second to
+  last axis, and are cast to the cache type. Views of `layer` returned
+  by `keys/2` and `values/2` are deallocated. Returns the cache.
+  """
+  def append(%__MODULE__{} = cache, layer, keys, values) do
+    [keys, values] =
+      Enum.map([keys, values], &(&1 |> Nx.to_tensor() |> EMLX.Backend.from_nx()))
+
+    :ok = EMLX.kv_cache_append(cache.ref, layer, keys, values)
+    cache
+  end
+
+  @doc """
+  The keys stored in `layer`, as a view of shape `shape` with the
+  second to last axis cut to `length/2`.
+  """
+  def keys(%__MODULE__{} = cache, layer), do: view(cache, EMLX.kv_cache_keys(cache.ref, layer))
+
+  @doc """
+  The values stored in `layer`. See `keys/2`.
+  """
+  def values(%__MODULE__{} = cache, layer),
+    do: view(cache, EMLX.kv_cache_values(cache.ref, layer))
+
+  @doc """
+  The number of steps stored in `layer`, at most `max_len`.
+  """
+  def length(%__MODULE__{} = cache, layer), do: EMLX.kv_cache_length(cache.ref, layer)
+
+  @doc """
+  Empties every layer, keeping the buffers for reuse.
+  """
+  def reset(%__MODULE__{} = cache) do
+    :ok = EMLX.kv_cache_reset(cache.ref)
+    cache
+  end
+
+  defp view(cache, ref) do
+    EMLX.Backend.to_nx(ref, Nx.template(EMLX.shape(ref), cache.type))
+  end
+
+  defp default_device do
+    case Nx.default_backend() do
+      {EMLX.Backend, opts} -> opts[:device] || :cpu
+      _ -> :cpu
+    end
+  end
+end
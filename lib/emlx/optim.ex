@@ -0,0 +1,171 @@
+defmodule EMLX.Optim do
+  @moduledoc """
+  Optimizer steps over whole parameter trees in a single NIF call.
+
+  A step updates every parameter with one fused MLX kernel per tensor,
+  instead of one call per elementwise operation per parameter:
+
+      state = EMLX.Optim.init(:adamw, params)
+
+      {params, state} =
+        EMLX.Optim.update(:adamw, params, grads, state, learning_rate: 1.0e-3)
+
+  `params` and `grads` are `Nx.Container`s of the same structure, such
+  as the nested maps of a model state. The returned state holds the step
+  count and the optimizer buffers, with the same structure as `params`.
+
+  ## Optimizers
+
+    * `:sgd` - stochastic gradient descent with optional momentum
+
+    * `:adam` - Adam, where `:weight_decay` adds an L2 term to the
+      gradients
+
+    * `:adamw` - Adam with decoupled weight decay
+  """
+
+  @optimizers [:sgd, :adam, :adamw]
+
+  @doc """
+  Creates the optimizer state for `params`, with zeroed buffers of the
+  same shapes and types.
+  """
+  def init(optimizer, params) when optimizer in @optimizers do
+    zeros = fn ->
+      Nx.Defn.Composite.traverse(params, &Nx.broadcast(Nx.tensor(0, type: &1.type), &1))
+    end
+
+    case optimizer do
+      :sgd -> %{step: 0, trace: zeros.()}
+      _adam -> %{step: 0, mu: zeros.(), nu: zeros.()}
+    end
+  end
+
+  @doc """
+  Applies one step of `optimizer` and returns `{params, state}`.
+
+  ## Options
+
+    * `:learning_rate` - defaults to `1.0e-2` for `:sgd` and `1.0e-3`
+      otherwise
+
+    * `:weight_decay` - defaults to `1.0e-2` for `:adamw` and `0.0`
+      otherwise
+
+    * `:momentum` and `:nesterov` - for `:sgd`. Default to `0.0` and
+      `false`
+
+    * `:b1`, `:b2` and `:eps` - for `:adam` and `:adamw`. Default to
+      `0.9`, `0.999` and `1.0e-8`
+
+    * `:donate` - when `true`, the given params and state are released
+      once the step is issued, so MLX can write the results into their
+      buffers instead of allocating new ones. They must not be used
+      afterwards. Defaults to `false`
+  """
+  def update(optimizer, params, grads, state, opts \\ [])
+
+  def update(:sgd, params, grads, %{step: step, trace: trace}, opts) do
+    opts =
+      Keyword.validate!(opts,
+        learning_rate: 1.0e-2,
+        momentum: 0.0,
+        weight_decay: 0.0,
+        nesterov: false,
+        donate: false
+      )
+
+    {device, [params_refs, grads_refs, trace_refs]} = refs([params, grads, trace])
+
+    [new_params, new_trace] =
+      params_refs
+      |> EMLX.optim_sgd(
+        grads_refs,
+        trace_refs,
+        opts[:learning_rate] * 1.0,
+        opts[:momentum] * 1.0,
+        opts[:weight_decay] * 1.0,
+        opts[:nesterov],
+        device
+      )
+      |> rebuild(device, [params, trace])
+
+    if opts[:donate], do: deallocate([params_refs, trace_refs])
+    {new_params, %{step: step + 1, trace: new_trace}}
+  end
+
+  def update(optimizer, params, grads, %{step: step, mu: mu, nu: nu}, opts)
+      when optimizer in [:adam, :adamw] do
+    opts =
+      Keyword.validate!(opts,
+        learning_rate: 1.0e-3,
+        b1: 0.9,
+        b2: 0.999,
+        eps: 1.0e-8,
+        weight_decay: if(optimizer == :adamw, do: 1.0e-2, else: 0.0),
+        donate: false
+      )
+
+    {l2_decay, decoupled_decay} =
+      if optimizer == :adamw,
+        do: {0.0, opts[:weight_decay] * 1.0},
+        else: {opts[:weight_decay] * 1.0, 0.0}
+
+    t = step + 1
+    {device, [params_refs, grads_refs, mu_refs, nu_refs]} = refs([params, grads, mu, nu])
+
+    [new_params, new_mu, new_nu] =
+      params_refs
+      |> EMLX.optim_adam(
+        grads_refs,
+        mu_refs,
+        nu_refs,
+        opts[:learning_rate] * 1.0,
+        opts[:b1] * 1.0,
+        opts[:b2] * 1.0,
+        opts[:eps] * 1.0,
+        l2_decay,
+        decoupled_decay,
+        1.0 - :math.pow(opts[:b1], t),
+        1.0 - :math.pow(opts[:b2], t),
+        device
+      )
+      |> rebuild(device, [params, mu, nu])
+
+    if opts[:donate], do: deallocate([params_refs, mu_refs, nu_refs])
+    {new_params, %{step: t, mu: new_mu, nu: new_nu}}
+  end
+
+  # Flattens each container to its list of refs. Results go to the
+  # device of the first param.
+  defp refs([params | _] = containers) do
+    lists =
+      Enum.map(containers, fn container ->
+        [container]
+        |> Nx.Defn.Composite.flatten_list()
+        |> Enum.map(&EMLX.Backend.from_nx/1)
+      end)
+
+    case hd(lists) do
+      [{device, _} | _] -> {device, lists}
+      [] -> raise ArgumentError, "expected at least one parameter, got: #{inspect(params)}"
+    end
+  end
+
+  # Splits the flat NIF result into one container per template
+  defp rebuild(refs, device, templates) do
+    {containers, []} =
+      Enum.map_reduce(templates, refs, fn template, refs ->
+        Nx.Defn.Composite.traverse(template, refs, fn tensor, [ref | refs] ->
+          {EMLX.Backend.to_nx({device, ref}, tensor), refs}
+        end)
+      end)
+
+    containers
+  end
+
+  defp deallocate(ref_lists) do
+    for refs <- ref_lists, ref <- refs, do: EMLX.deallocate(ref)
+    :ok
+  end
+end
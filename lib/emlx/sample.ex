@@ -0,0 +1,66 @@
+defmodule EMLX.Sample do
+  @moduledoc """
+  Token sampling for autoregressive decoding.
+  """
+
+  @doc """
+  Samples a token id from each row of `logits` with the PRNG `key`
+  (as returned by `Nx.Random.key/1`).
+
+  Temperature scaling, the top-k and top-p filters and the categorical
+  draw run as one MLX computation, without vocabulary-sized round trips
+  through Nx and without waiting for the result. The returned `{:s, 32}`
+  tensor has the shape of `logits` without its last axis.
+
+      token = EMLX.Sample.token(logits, key, temperature: 0.7, top_p: 0.9)
+
+  The same key gives the same tokens, so use a new one for each step,
+  for example with `Nx.Random.split/2`.
+
+  ## Options
+
+    * `:temperature` - divides the logits before sampling. `0` picks the
+      most likely token. Defaults to `1.0`
+
+    * `:top_k` - only samples among the `k` most likely tokens. `0`
+      (the default) keeps all of them
+
+    * `:top_p` - only samples among the most likely tokens whose
+      probabilities add up to `top_p` (nucleus sampling), in `(0, 1]`.
+      Defaults to `1.0`, which keeps all of them
+  """
+  def token(logits, key, opts \\ []) do
+    opts = Keyword.validate!(opts, temperature: 1.0, top_k: 0, top_p: 1.0)
+    logits = Nx.to_tensor(logits)
+
+    unless is_integer(opts[:top_k]) and opts[:top_k] >= 0 do
+      raise ArgumentError,
+            "expected :top_k to be a non-negative integer, got: #{inspect(opts[:top_k])}"
+    end
+
+    # BEAM floats are always finite, so this also rejects :nan and :infinity
+    unless is_number(opts[:temperature]) and opts[:temperature] >= 0 do
+      raise ArgumentError,
+            "expected :temperature to be a finite non-negative number, " <>
+              "got: #{inspect(opts[:temperature])}"
+    end
+
+    # With top_p <= 0 every token would be filtered out
+    unless is_number(opts[:top_p]) and opts[:top_p] > 0 and opts[:top_p] <= 1 do
+      raise ArgumentError,
+            "expected :top_p to be a number in (0, 1], got: #{inspect(opts[:top_p])}"
+    end
+
+    out = Nx.template(Tuple.delete_at(logits.shape, tuple_size(logits.shape) - 1), {:s, 32})
+
+    logits
+    |> EMLX.Backend.from_nx()
+    |> EMLX.sample_token(
+      EMLX.Backend.from_nx(Nx.to_tensor(key)),
+      opts[:temperature] * 1.0,
+      opts[:top_k],
+      opts[:top_p] * 1.0
+    )
+    |> EMLX.Backend.to_nx(out)
+  end
+end
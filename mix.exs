@@ -55,7 +55,8 @@ defmodule EMLX.MixProject do
   defp deps do
     [
       {:elixir_make, "~> 0.6"},
-      {:nx, "~> 0.9.2"}
+      {:nx, "~> 0.9.2"},
+      {:telemetry, "~> 0.4.0 or ~> 1.0"}
     ]
   end
 
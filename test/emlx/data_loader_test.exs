@@ -0,0 +1,57 @@
+defmodule EMLX.DataLoaderTest do
+  use EMLX.Case, async: true
+
+  alias EMLX.DataLoader
+
+  defp batches(count), do: for(i <- 0..(count - 1), do: Nx.iota({2, 3}, type: :u8) |> Nx.add(i))
+
+  test "uploads batches in order" do
+    expected = batches(5)
+
+    result =
+      expected
+      |> Enum.map(&Nx.to_binary/1)
+      |> DataLoader.stream(shape: {2, 3}, type: :u8, as: :f32, prefetch: 2)
+      |> Enum.to_list()
+
+    assert length(result) == 5
+
+    for {tensor, batch} <- Enum.zip(result, expected) do
+      assert tensor.type == {:f, 32}
+      assert_equal(tensor, Nx.as_type(batch, :f32))
+    end
+
+    assert Enum.to_list(DataLoader.stream([], shape: {2, 3}, type: :u8)) == []
+  end
+
+  test "stops pulling the source when halted" do
+    source =
+      batches(10)
+      |> Stream.map(&Nx.to_binary/1)
+      |> Stream.each(fn _ -> send(self(), :pulled) end)
+
+    [first, second] = source |> DataLoader.stream(shape: {2, 3}, type: :u8) |> Enum.take(2)
+    assert_equal(second, Nx.add(first, 1))
+
+    # Two batches were taken and at most two more prefetched
+    assert pulled(0) <= 4
+
+    refute_received {_ref, {:ok, _}}
+  end
+
+  defp pulled(count) do
+    receive do
+      :pulled -> pulled(count + 1)
+    after
+      0 -> count
+    end
+  end
+
+  test "raises on short binaries" do
+    assert_raise EMLX.NIFError, ~r/too small/, fn ->
+      [<<1, 2, 3>>]
+      |> DataLoader.stream(shape: {2, 3}, type: :u8)
+      |> Enum.to_list()
+    end
+  end
+end
@@ -0,0 +1,56 @@
+defmodule EMLX.ExecutorTest do
+  # The executor limits are global
+  use EMLX.Case, async: false
+
+  alias EMLX.Executor
+
+  setup do
+    %{max_concurrency: max_concurrency, max_queue: max_queue} = Executor.stats()
+    on_exit(fn -> Executor.configure(max_concurrency: max_concurrency, max_queue: max_queue) end)
+  end
+
+  test "evaluates containers" do
+    a = Nx.iota({3}, type: :f32)
+    b = Nx.multiply(a, 2)
+
+    assert {:ok, {^a, %{b: ^b}}} = Executor.eval({a, %{b: b}}, priority: :batch)
+    assert_equal(b, Nx.tensor([0.0, 2.0, 4.0]))
+
+    assert {:ok, %{}} = Executor.eval(%{})
+  end
+
+  test "reports completed evaluations" do
+    handler = "executor-test-#{inspect(self())}"
+    parent = self()
+
+    :telemetry.attach(
+      handler,
+      [:emlx, :executor, :eval],
+      fn _, measurements, metadata, _ -> send(parent, {:eval, measurements, metadata}) end,
+      nil
+    )
+
+    completed = Executor.stats().completed
+    {:ok, _} = Executor.eval(Nx.exp(Nx.iota({4}, type: :f32)))
+    :telemetry.detach(handler)
+
+    assert_received {:eval, %{queue_depth: depth, duration: duration},
+                     %{priority: :interactive}}
+
+    assert depth >= 1 and duration >= 0
+    assert Executor.stats().completed > completed
+  end
+
+  test "jit evaluates through the executor" do
+    fun = Nx.Defn.jit(&Nx.add(&1, 1), compiler: EMLX, priority: :interactive)
+    assert_equal(fun.(Nx.tensor([1, 2])), Nx.tensor([2, 3]))
+  end
+
+  test "configures the limits" do
+    assert :ok = Executor.configure(max_concurrency: 1, max_queue: 8)
+    assert %{max_concurrency: 1, max_queue: 8} = Executor.stats()
+
+    assert_raise EMLX.NIFError, ~r/positive/, fn -> Executor.configure(max_queue: 0) end
+    assert_raise ArgumentError, fn -> Executor.eval(Nx.iota({2}), priority: :high) end
+  end
+end
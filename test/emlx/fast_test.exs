@@ -0,0 +1,173 @@
+defmodule EMLX.FastTest do
+  use EMLX.Case, async: true
+
+  alias Nx.Defn.Expr
+
+  defp softmax(x) do
+    exp = Nx.exp(Nx.subtract(x, Nx.reduce_max(x, axes: [1], keep_axes: true)))
+    Nx.divide(exp, Nx.sum(exp, axes: [1], keep_axes: true))
+  end
+
+  defp log_softmax(x) do
+    shifted = Nx.subtract(x, Nx.stop_grad(Nx.reduce_max(x, axes: [1], keep_axes: true)))
+    Nx.subtract(shifted, Nx.log(Nx.sum(Nx.exp(shifted), axes: [1], keep_axes: true)))
+  end
+
+  defp logsumexp(x), do: Nx.log(Nx.sum(Nx.exp(x), axes: [1]))
+
+  defp fused_op(%Nx.Tensor{data: %Expr{op: :optional, args: [call | _]}}), do: call.data.op
+  defp fused_op(%Nx.Tensor{data: %Expr{op: op}}), do: op
+
+  setup do
+    {:ok, x: Nx.tensor([[1.0, 2.0, 3.0], [-1.0, 0.0, 10.0]])}
+  end
+
+  test "fused ops match the Nx formulations", %{x: x} do
+    assert_all_close(EMLX.Fast.softmax(x), softmax(x))
+    assert_all_close(EMLX.Fast.log_softmax(x), log_softmax(x))
+    assert_all_close(EMLX.Fast.logsumexp(x), logsumexp(x))
+
+    assert_all_close(
+      EMLX.Fast.logsumexp(x, axes: [0], keep_axes: true),
+      Nx.log(Nx.sum(Nx.exp(x), axes: [0], keep_axes: true))
+    )
+  end
+
+  test "fall back on other backends", %{x: x} do
+    x = Nx.backend_copy(x, Nx.BinaryBackend)
+
+    assert_all_close(EMLX.Fast.softmax(x), softmax(x))
+    assert_all_close(EMLX.Fast.logsumexp(x, keep_axes: true), Nx.new_axis(logsumexp(x), 1))
+  end
+
+  test "the compiler rewrites the canonical patterns", %{x: x} do
+    for {fun, op} <- [
+          {&softmax/1, :fast_softmax},
+          {&log_softmax/1, :fast_log_softmax},
+          {&logsumexp/1, :fast_logsumexp}
+        ] do
+      expr = Nx.Defn.debug_expr(fun).(x)
+      assert fused_op(EMLX.Fast.rewrite(expr)) == op
+
+      assert_all_close(Nx.Defn.jit(fun, compiler: EMLX).(x), fun.(x))
+    end
+  end
+
+  test "chained convolutions stay channels-last" do
+    input = Nx.iota({1, 2, 5, 5}, type: :f32) |> Nx.divide(10)
+    k1 = Nx.iota({3, 2, 2, 2}, type: :f32) |> Nx.divide(7)
+    k2 = Nx.iota({4, 3, 2, 2}, type: :f32) |> Nx.subtract(20) |> Nx.divide(9)
+
+    fun = fn input, k1, k2 -> input |> Nx.conv(k1) |> Nx.conv(k2) end
+
+    expr = EMLX.Fast.rewrite(Nx.Defn.debug_expr(fun).(input, k1, k2))
+    assert %Expr{op: :transpose, args: [conv, _]} = expr.data
+    assert %Expr{op: :conv, args: [%Nx.Tensor{data: %Expr{op: :conv}} | _]} = conv.data
+
+    expected = apply(fun, Enum.map([input, k1, k2], &Nx.backend_copy(&1, Nx.BinaryBackend)))
+    assert_all_close(Nx.Defn.jit(fun, compiler: EMLX).(input, k1, k2), expected)
+  end
+
+  test "bias adds and activations between convolutions stay channels-last" do
+    input = Nx.iota({1, 2, 5, 5}, type: :f32) |> Nx.divide(10)
+    k1 = Nx.iota({3, 2, 2, 2}, type: :f32) |> Nx.divide(7)
+    bias = Nx.tensor([0.5, -1.0, 2.0]) |> Nx.reshape({1, 3, 1, 1})
+    k2 = Nx.iota({4, 3, 2, 2}, type: :f32) |> Nx.subtract(20) |> Nx.divide(9)
+
+    fun = fn input, k1, bias, k2 ->
+      input |> Nx.conv(k1) |> Nx.add(bias) |> Nx.max(0) |> Nx.sigmoid() |> Nx.conv(k2)
+    end
+
+    expr = EMLX.Fast.rewrite(Nx.Defn.debug_expr(fun).(input, k1, bias, k2))
+    assert %Expr{op: :transpose, args: [conv, _]} = expr.data
+    assert %Expr{op: :conv, args: [between | _]} = conv.data
+    assert ops_until_conv(between) == [:sigmoid, :max, :add]
+
+    expected =
+      apply(fun, Enum.map([input, k1, bias, k2], &Nx.backend_copy(&1, Nx.BinaryBackend)))
+
+    assert_all_close(Nx.Defn.jit(fun, compiler: EMLX).(input, k1, bias, k2), expected)
+  end
+
+  defp ops_until_conv(%Nx.Tensor{data: %Expr{op: :conv}}), do: []
+  defp ops_until_conv(%Nx.Tensor{data: %Expr{op: op, args: [arg | _]}}),
+    do: [op | ops_until_conv(arg)]
+
+  test "channels-last convolutions" do
+    input = Nx.iota({1, 5, 5, 2}, type: :f32) |> Nx.divide(10)
+    kernel = Nx.iota({3, 2, 2, 2}, type: :f32) |> Nx.divide(7)
+    opts = [input_permutation: [0, 3, 1, 2], output_permutation: [0, 3, 1, 2]]
+
+    expected =
+      input
+      |> Nx.backend_copy(Nx.BinaryBackend)
+      |> Nx.conv(Nx.backend_copy(kernel, Nx.BinaryBackend), opts)
+
+    assert_all_close(Nx.conv(input, kernel, opts), expected)
+  end
+
+  test "addmm" do
+    c = Nx.tensor([1.0, -1.0])
+    a = Nx.iota({3, 4}, type: :f32)
+    b = Nx.iota({4, 2}, type: :f32) |> Nx.divide(3)
+
+    assert_all_close(EMLX.Fast.addmm(c, a, b), Nx.add(Nx.dot(a, b), c))
+
+    assert_all_close(
+      EMLX.Fast.addmm(c, a, b, alpha: 2, beta: 0.5),
+      Nx.add(Nx.multiply(Nx.dot(a, b), 2), Nx.multiply(c, 0.5))
+    )
+
+    fun = fn a, b, c -> Nx.add(c, Nx.dot(a, b)) end
+    expr = EMLX.Fast.rewrite(Nx.Defn.debug_expr(fun).(a, b, c))
+    assert fused_op(expr) == :fast_addmm
+    assert_all_close(Nx.Defn.jit(fun, compiler: EMLX).(a, b, c), fun.(a, b, c))
+
+    # Two free axes on the left are flattened for matmul, so this one
+    # falls back to dot and add
+    a = Nx.iota({2, 3, 4}, type: :f32)
+    assert_all_close(EMLX.Fast.addmm(c, a, b), Nx.add(Nx.dot(a, b), c))
+
+    c = Nx.tensor([[[1.0, 2.0]]])
+    b = Nx.iota({2, 4, 2}, type: :f32)
+
+    assert_all_close(
+      EMLX.Fast.addmm(c, a, b, contract_axes: {[2], [1]}, batch_axes: {[0], [0]}),
+      Nx.add(Nx.dot(a, [2], [0], b, [1], [0]), c)
+    )
+  end
+
+  test "gather_mm" do
+    x = Nx.iota({4, 1, 3}, type: :f32) |> Nx.divide(5)
+    experts = Nx.iota({2, 3, 2}, type: :f32) |> Nx.subtract(4)
+    assignment = Nx.tensor([1, 0, 0, 1])
+
+    expected =
+      for {token, expert} <- Enum.zip(0..3, Nx.to_flat_list(assignment)) do
+        Nx.dot(x[token], experts[expert])
+      end
+      |> Nx.stack()
+
+    assert_all_close(EMLX.Fast.gather_mm(x, experts, rhs_indices: assignment), expected)
+
+    [x_bin, experts_bin, assignment_bin] =
+      Enum.map([x, experts, assignment], &Nx.backend_copy(&1, Nx.BinaryBackend))
+
+    assert_all_close(
+      EMLX.Fast.gather_mm(x_bin, experts_bin, rhs_indices: assignment_bin),
+      expected
+    )
+
+    # Indices broadcast against each other
+    lhs = Nx.tensor([[0], [3]])
+    rhs = Nx.tensor([0, 1])
+    out = EMLX.Fast.gather_mm(x, experts, lhs_indices: lhs, rhs_indices: rhs)
+    assert out.shape == {2, 2, 1, 2}
+    assert_all_close(out[1][0], Nx.dot(x[3], experts[0]))
+  end
+
+  test "integer inputs are not rewritten" do
+    expr = Nx.Defn.debug_expr(&logsumexp/1).(Nx.iota({2, 3}))
+    assert fused_op(EMLX.Fast.rewrite(expr)) == :log
+  end
+end
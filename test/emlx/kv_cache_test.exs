@@ -0,0 +1,102 @@
+defmodule EMLX.KVCacheTest do
+  use EMLX.Case, async: true
+
+  alias EMLX.KVCache
+
+  defp steps(from, count), do: Nx.iota({2, count, 3}, type: :f32) |> Nx.add(from * 100)
+
+  test "appends steps and returns views of the filled part" do
+    cache = KVCache.new(2, {2, 4, 3})
+
+    assert KVCache.length(cache, 0) == 0
+    assert KVCache.keys(cache, 0).shape == {2, 0, 3}
+
+    KVCache.append(cache, 0, steps(0, 1), Nx.negate(steps(0, 1)))
+    KVCache.append(cache, 0, steps(1, 2), Nx.negate(steps(1, 2)))
+
+    expected = Nx.concatenate([steps(0, 1), steps(1, 2)], axis: 1)
+    assert KVCache.length(cache, 0) == 3
+    assert_equal(KVCache.keys(cache, 0), expected)
+    assert_equal(KVCache.values(cache, 0), Nx.negate(expected))
+
+    # Layers are independent
+    assert KVCache.length(cache, 1) == 0
+
+    KVCache.append(cache, 0, steps(3, 1), steps(3, 1))
+
+    assert_raise EMLX.NIFError, ~r/full/, fn ->
+      KVCache.append(cache, 0, steps(4, 1), steps(4, 1))
+    end
+
+    KVCache.reset(cache)
+    assert KVCache.length(cache, 0) == 0
+  end
+
+  test "rejects steps that do not match the cache shape" do
+    cache = KVCache.new(1, {2, 4, 3})
+    KVCache.append(cache, 0, steps(0, 1), steps(0, 1))
+
+    # slice_update would broadcast these over the heads
+    assert_raise EMLX.NIFError, ~r/cache shape/, fn ->
+      KVCache.append(cache, 0, Nx.iota({1, 1, 3}, type: :f32), steps(1, 1))
+    end
+
+    # Valid keys with invalid values are not written either
+    assert_raise EMLX.NIFError, ~r/cache shape/, fn ->
+      KVCache.append(cache, 0, steps(1, 1), Nx.iota({2, 1, 2}, type: :f32))
+    end
+
+    assert KVCache.length(cache, 0) == 1
+    assert_equal(KVCache.keys(cache, 0), steps(0, 1))
+    assert_equal(KVCache.values(cache, 0), steps(0, 1))
+  end
+
+  test "appends release the views handed out" do
+    cache = KVCache.new(1, {2, 8, 3})
+    KVCache.append(cache, 0, steps(0, 1), steps(0, 1))
+
+    {view, pending, expected} =
+      for i <- 1..4, reduce: nil do
+        _ ->
+          view = KVCache.keys(cache, 0)
+          expected = Nx.concatenate(for(j <- 0..(i - 1), do: steps(j, 1)), axis: 1)
+          assert_equal(Nx.sum(view), Nx.sum(expected))
+
+          # Built on the view but evaluated after the append, which then
+          # copies the buffer instead of writing in place
+          pending = Nx.multiply(view, 2)
+          KVCache.append(cache, 0, steps(i, 1), steps(i, 1))
+          {view, pending, expected}
+      end
+
+    # Appends deallocate the views, so the cache usually holds the only
+    # reference to its buffers and MLX writes into them in place
+    assert_raise EMLX.NIFError, ~r/deallocated/, fn -> Nx.to_binary(view) end
+
+    assert_equal(pending, Nx.multiply(expected, 2))
+  end
+
+  test "ring buffers keep the last max_len steps" do
+    cache = KVCache.new(1, {2, 3, 3}, mode: :ring, type: :f16)
+
+    KVCache.append(cache, 0, steps(0, 2), steps(0, 2))
+    KVCache.append(cache, 0, steps(2, 2), steps(2, 2))
+
+    # The fourth step wrapped around into the first slot
+    assert KVCache.length(cache, 0) == 3
+    keys = KVCache.keys(cache, 0)
+    assert keys.type == {:f, 16}
+
+    [a, b] = [steps(0, 2), steps(2, 2)]
+    expected = Nx.concatenate([b[[.., 1..1, ..]], a[[.., 1..1, ..]], b[[.., 0..0, ..]]], axis: 1)
+    assert_equal(keys, Nx.as_type(expected, :f16))
+
+    # Writes longer than the buffer keep their tail
+    KVCache.append(cache, 0, steps(5, 4), steps(5, 4))
+
+    assert_equal(
+      Nx.sort(KVCache.values(cache, 0), axis: 1),
+      Nx.as_type(steps(5, 4)[[.., 1..3, ..]], :f16)
+    )
+  end
+end
@@ -355,6 +355,44 @@ defmodule EMLX.NxTest do
         ])
       )
     end
+
+    test "fft of real inputs mirrors the half spectrum" do
+      real = Nx.iota({2, 5, 6}, type: :f32) |> Nx.sin()
+      complex = Nx.as_type(real, :c64)
+
+      for length <- [4, 5, 6, 8] do
+        assert_all_close(Nx.fft(real, length: length), Nx.fft(complex, length: length))
+      end
+
+      assert_all_close(Nx.fft2(real), Nx.fft2(complex))
+
+      assert_all_close(
+        Nx.fft2(real, axes: [0, 2], lengths: [3, 5]),
+        Nx.fft2(complex, axes: [0, 2], lengths: [3, 5])
+      )
+    end
+
+    test "rfft and irfft round trip" do
+      t = Nx.iota({3, 8}, type: :f32) |> Nx.cos()
+      ref = EB.from_nx(t)
+
+      half = EMLX.rfft(ref, 8, -1)
+      assert EMLX.shape(half) == {3, 5}
+      assert_all_close(EB.to_nx(half), Nx.slice_along_axis(Nx.fft(t), 0, 5, axis: 1))
+      assert_all_close(EMLX.irfft(half, 8, -1) |> EB.to_nx(), t)
+
+      half = EMLX.rfft2(ref, [3, 8], [0, 1])
+      assert EMLX.shape(half) == {3, 5}
+      assert_all_close(EMLX.irfft2(half, [3, 8], [0, 1]) |> EB.to_nx(), t)
+
+      half = EMLX.rfftn(ref, [3, 8], [0, 1])
+      assert_all_close(EMLX.irfftn(half, [3, 8], [0, 1]) |> EB.to_nx(), t)
+
+      assert_all_close(
+        EMLX.fftn(ref, [3, 8], [0, 1]) |> EMLX.ifftn([3, 8], [0, 1]) |> EB.to_nx() |> Nx.real(),
+        t
+      )
+    end
   end
 
   # Division and power with bfloat16 are special cases in PyTorch,
@@ -480,6 +518,27 @@ defmodule EMLX.NxTest do
       assert_equal(Nx.dot(t2, t1), Nx.tensor(32))
     end
 
+    test "dot layouts that map to matmul match the binary backend" do
+      for {left_shape, left_contract, left_batch, right_shape, right_contract, right_batch} <- [
+            {{2, 3, 4}, [2], [0], {2, 4, 5}, [1], [0]},
+            {{2, 3, 4}, [2], [0], {2, 5, 4}, [2], [0]},
+            {{2, 4, 3}, [1], [0], {2, 4, 5}, [1], [0]},
+            {{3, 2, 4}, [1, 2], [], {2, 4, 5}, [0, 1], []},
+            {{4}, [0], [], {5, 4}, [1], []},
+            {{6, 3, 4}, [2], [], {4}, [0], []}
+          ],
+          type <- [:f32, :s32] do
+        left = Nx.iota(left_shape, type: type) |> Nx.subtract(5)
+        right = Nx.iota(right_shape, type: type) |> Nx.remainder(7)
+
+        [binary_left, binary_right] =
+          Enum.map([left, right], &Nx.backend_copy(&1, Nx.BinaryBackend))
+
+        dot = &Nx.dot(&1, left_contract, left_batch, &2, right_contract, right_batch)
+        assert_equal(dot.(left, right), dot.(binary_left, binary_right))
+      end
+    end
+
     test "make_diagonal" do
       t =
         [1, 2, 3]
@@ -986,6 +1045,35 @@ defmodule EMLX.NxTest do
         Nx.tensor([[0, 0, -1, 1, 0, -2], [-3, 0, 4, -4, 0, 5]])
       )
     end
+
+    test "input_dilation with padding, strides and groups matches the binary backend" do
+      t = Nx.iota({2, 4, 5, 6}, type: :f32) |> Nx.divide(10)
+
+      for {kernel_shape, opts} <- [
+            {{6, 4, 3, 2}, input_dilation: [2, 1], strides: [1, 2], padding: [{1, 2}, {0, 1}]},
+            {{6, 2, 3, 2},
+             input_dilation: [3, 2], padding: [{2, -1}, {1, 1}], feature_group_size: 2},
+            {{3, 4, 2, 3}, input_dilation: [2, 2], padding: :same}
+          ] do
+        k = Nx.iota(kernel_shape, type: :f32) |> Nx.subtract(17) |> Nx.divide(5)
+
+        [binary_t, binary_k] = Enum.map([t, k], &Nx.backend_copy(&1, Nx.BinaryBackend))
+        expected = Nx.conv(binary_t, binary_k, opts)
+
+        assert_all_close(Nx.conv(t, k, opts), expected)
+      end
+    end
+
+    test "gradient of a strided conv" do
+      t = Nx.iota({1, 2, 7, 6}, type: :f32) |> Nx.divide(10)
+      k = Nx.iota({3, 2, 3, 3}, type: :f32) |> Nx.subtract(20) |> Nx.divide(9)
+      fun = fn t, k -> t |> Nx.conv(k, strides: [2, 3], padding: :same) |> Nx.sum() end
+
+      binary_k = Nx.backend_copy(k, Nx.BinaryBackend)
+      expected = Nx.Defn.grad(Nx.backend_copy(t, Nx.BinaryBackend), &fun.(&1, binary_k))
+
+      assert_all_close(Nx.Defn.grad(t, &fun.(&1, k)), expected)
+    end
   end
 
   describe "window_max" do
@@ -1308,6 +1396,591 @@ defmodule EMLX.NxTest do
     end
   end
 
+  describe "packed sub-byte types" do
+    for type <- [{:u, 2}, {:u, 4}, {:s, 2}, {:s, 4}] do
+      test "round-trips #{Nx.Type.to_string(type)} through packed storage" do
+        type = unquote(type)
+        {min, max} = if elem(type, 0) == :u, do: {0, 2 ** elem(type, 1) - 1}, else: {-2, 1}
+
+        data = Enum.map(0..6, &(min + rem(&1, max - min + 1)))
+        t = Nx.tensor(data, type: type)
+        binary_t = Nx.tensor(data, type: type, backend: Nx.BinaryBackend)
+
+        assert Nx.to_binary(t) == Nx.to_binary(binary_t)
+        assert Nx.to_binary(t, limit: 3) == Nx.to_binary(binary_t, limit: 3)
+        assert Nx.to_flat_list(t) == data
+
+        # 7 elements fit in ceil(7 * bits / 8) bytes
+        %{data: %EB{ref: packed_ref}} = t
+        assert EMLX.shape(packed_ref) == {div(7 * elem(type, 1) + 7, 8)}
+        assert EMLX.scalar_type(packed_ref) == :uint8
+      end
+    end
+
+    test "computes on unpacked values and packs the result" do
+      a = Nx.tensor([[-8, -1], [3, 7]], type: {:s, 4})
+      b = Nx.tensor([[1, 1], [2, -8]], type: {:s, 4})
+
+      assert_equal(Nx.add(a, b), Nx.tensor([[-7, 0], [5, -1]], type: {:s, 4}))
+      assert Nx.sum(a) |> Nx.to_number() == 1
+      assert Nx.reduce_max(Nx.tensor([1, 3, 2], type: {:u, 2})) |> Nx.to_number() == 3
+    end
+  end
+
+  describe "f8 storage" do
+    test "stores one byte per element and matches the binary backend" do
+      data = [1.0, -2.5, 0.0, 448.0, :infinity, :neg_infinity]
+      t = Nx.tensor(data, type: {:f, 8})
+      binary_t = Nx.tensor(data, type: {:f, 8}, backend: Nx.BinaryBackend)
+
+      assert Nx.to_binary(t) == Nx.to_binary(binary_t)
+      assert Nx.to_flat_list(t) == Nx.to_flat_list(binary_t)
+
+      %{data: %EB{ref: storage_ref}} = t
+      assert EMLX.shape(storage_ref) == {6}
+      assert EMLX.scalar_type(storage_ref) == :uint8
+    end
+
+    test "computes in float16 and keeps NaN on the way back" do
+      a = Nx.tensor([1.0, 2.0, 4.0], type: {:f, 8})
+      b = Nx.tensor([0.5, 0.0, 4.0], type: {:f, 8})
+
+      assert_equal(Nx.add(a, b), Nx.tensor([1.5, 2.0, 8.0], type: {:f, 8}))
+      assert Nx.divide(b, b) |> Nx.is_nan() |> Nx.to_flat_list() == [0, 1, 0]
+
+      assert Nx.as_type(a, :f32) |> Nx.to_flat_list() == [1.0, 2.0, 4.0]
+    end
+  end
+
+  describe "float64" do
+    # Only runs when EMLX is built against an MLX with float64, which
+    # the pinned MLX 0.21.1 is not (see test_helper.exs and the README)
+    @describetag :float64
+
+    test "stores and computes f64 natively on the CPU" do
+      a = Nx.tensor([1.0, 2.0], type: :f64)
+      b = Nx.tensor([1.0e-10, 0.5], type: :f64)
+
+      %{data: %EB{ref: ref}} = a
+      assert EMLX.scalar_type(ref) == :float64
+
+      assert Nx.add(a, b) |> Nx.to_flat_list() == [1.0000000001, 2.5]
+      assert Nx.sum(b, type: :f64) |> Nx.to_number() == 0.5000000001
+    end
+  end
+
+  describe "64-bit sizes" do
+    test "rejects dimensions that do not fit in MLX shapes" do
+      assert_raise EMLX.NIFError, ~r/does not fit in a 32-bit MLX shape/, fn ->
+        EMLX.from_blob(<<0>>, {2 ** 31}, :uint8, :cpu)
+      end
+    end
+
+    test "arange with bounds past the int32 range" do
+      start = 2 ** 40
+      t = EMLX.arange(start, start + 3, 1, true, :cpu)
+
+      assert EMLX.scalar_type(t) == :int64
+
+      assert EMLX.to_blob(t) ==
+               <<start::native-64, start + 1::native-64, start + 2::native-64>>
+    end
+
+    @tag :large_memory
+    test "iota over more than 2^31 elements" do
+      t = Nx.iota({2, 2 ** 30 + 1}, type: :u8)
+
+      assert Nx.size(t) > 2 ** 31
+      assert t[[1, -1]] |> Nx.to_number() == rem(2 ** 31 + 1, 256)
+      assert t[[1, 0..3]] |> Nx.to_flat_list() == [1, 2, 3, 4]
+    end
+
+    @tag :large_memory
+    test "to_binary with a limit past 2^31 elements" do
+      t = Nx.broadcast(Nx.tensor(7, type: :u8), {2, 2 ** 30 + 1}) |> Nx.add(0)
+
+      binary = Nx.to_binary(t, limit: 2 ** 31 + 1)
+      assert byte_size(binary) == 2 ** 31 + 1
+      assert :binary.last(binary) == 7
+    end
+  end
+
+  describe "scalar operands" do
+    test "scalar constants are not allocated in MLX" do
+      t = EB.constant(Nx.template({}, :f32), 0.5, [])
+      assert %EB{ref: nil, scalar: {:cpu, 0.5}} = t.data
+
+      assert Nx.to_number(t) == 0.5
+      assert Nx.add(t, t) |> Nx.to_number() == 1.0
+    end
+
+    test "scalar constants are rounded to their own type" do
+      x = Nx.tensor([0.0], type: :f32)
+
+      tenth = Nx.tensor(0.1, type: :f16)
+      assert %EB{ref: {_, _}} = tenth.data
+      assert Nx.add(x, tenth) |> Nx.to_flat_list() == [0.0999755859375]
+
+      assert Nx.add(x, Nx.tensor(1.0e5, type: :f16)) |> Nx.to_flat_list() == [:infinity]
+      assert Nx.add(x, Nx.tensor(0.1, type: :bf16)) |> Nx.to_flat_list() == [0.10009765625]
+    end
+
+    test "two scalar constants keep their device" do
+      backend = {EB, device: :gpu}
+      sum = Nx.add(Nx.tensor(1.0, backend: backend), Nx.tensor(2.0, backend: backend))
+
+      assert %EB{ref: {:gpu, _}} = sum.data
+      assert Nx.to_number(sum) == 3.0
+    end
+
+    test "binary ops and clip take scalars on either side" do
+      x = Nx.tensor([1.0, -2.0, 3.0])
+
+      assert_equal(x |> Nx.multiply(0.5) |> Nx.add(1), Nx.tensor([1.5, 0.0, 2.5]))
+      assert_equal(Nx.subtract(1, x), Nx.tensor([0.0, 3.0, -2.0]))
+      assert_equal(Nx.greater(x, 0), Nx.tensor([1, 0, 1], type: :u8))
+      assert_equal(Nx.clip(x, 0, 2), Nx.tensor([1.0, 0.0, 2.0]))
+      assert_equal(Nx.remainder(-5, Nx.tensor([3, 4])), Nx.tensor([-2, -1]))
+      assert_equal(Nx.add(Nx.tensor([1, 2], type: :u8), 1), Nx.tensor([2, 3], type: :u8))
+
+      assert_equal(
+        Nx.multiply(Nx.tensor([1.0, 2.0]), Complex.new(0.0, 1.0)),
+        Nx.tensor([Complex.new(0.0, 1.0), Complex.new(0.0, 2.0)])
+      )
+    end
+
+    test "NIFs reject two scalar operands" do
+      assert EMLX.add(Nx.tensor([1, 2]) |> EB.from_nx(), 1) |> EMLX.to_blob() ==
+               <<2::native-32, 3::native-32>>
+
+      assert_raise EMLX.NIFError, ~r/At least one operand must be a tensor/, fn ->
+        EMLX.add(1, 2)
+      end
+    end
+
+    test "NIFs promote integer tensors with float scalars" do
+      ints = Nx.tensor([1, 2]) |> EB.from_nx()
+
+      assert EMLX.add(ints, 0.5) |> EMLX.to_blob() ==
+               <<1.5::float-native-32, 2.5::float-native-32>>
+
+      assert EMLX.subtract(1.5, ints) |> EMLX.to_blob() ==
+               <<0.5::float-native-32, -0.5::float-native-32>>
+
+      # Floats keep the dtype of float tensors
+      halves = Nx.tensor([1.0, 2.0], type: :f16) |> EB.from_nx()
+
+      assert EMLX.multiply(halves, 0.5) |> EMLX.to_blob() ==
+               Nx.to_binary(Nx.tensor([0.5, 1.0], type: :f16))
+    end
+  end
+
+  describe "wrapper clauses" do
+    setup do
+      {_, a} = Nx.tensor([1.0, 2.0]) |> EB.from_nx()
+      {_, b} = Nx.tensor([0.5, 0.5]) |> EB.from_nx()
+      {:ok, a: a, b: b}
+    end
+
+    test "fast and general clauses agree on devices and scalars", %{a: a, b: b} do
+      # Two tensors take the fast clause, a scalar operand the general one
+      fast = EMLX.add({:cpu, a}, {:gpu, b})
+      general = EMLX.add({:gpu, a}, 0.5)
+
+      assert {:gpu, _} = fast
+      assert {:gpu, _} = general
+      assert EMLX.to_blob(fast) == EMLX.to_blob(general)
+
+      assert {:cpu, _} = cpu = EMLX.add(0.5, {:cpu, a})
+      assert EMLX.to_blob(cpu) == EMLX.to_blob(fast)
+
+      # {device, index} tuples take the general defdevice clause
+      assert {:cpu, _} = indexed = EMLX.scalar_tensor(1.5, :float32, {:cpu, 0})
+      assert EMLX.to_blob(indexed) == EMLX.to_blob(EMLX.scalar_tensor(1.5, :float32, :cpu))
+    end
+
+    test "fast and general clauses agree on recorded tensors", %{a: a, b: b} do
+      eager = EMLX.add({:cpu, a}, EMLX.multiply({:cpu, b}, {:gpu, b}))
+
+      # The product is a slot inside the batch, so add takes the general
+      # clause, as does shape
+      {batched, shape} =
+        EMLX.batch(fn ->
+          product = EMLX.multiply({:cpu, b}, {:gpu, b})
+          {EMLX.add({:cpu, a}, product), EMLX.shape(product)}
+        end)
+
+      assert {:gpu, _} = batched
+      assert shape == {2}
+      assert EMLX.to_blob(batched) == EMLX.to_blob(eager)
+    end
+  end
+
+  describe "typed binary and reduction ops" do
+    test "promote, broadcast and cast in one NIF call" do
+      a = Nx.tensor([[1], [2]], type: :s32) |> EB.from_nx()
+      b = Nx.tensor([0.5, 1.5], type: :f32) |> EB.from_nx()
+
+      result = EMLX.add(a, b, :float32, :float16)
+
+      assert EMLX.scalar_type(result) == :float16
+      assert EMLX.shape(result) == {2, 2}
+      assert EMLX.to_blob(result) == Nx.to_binary(Nx.tensor([[1.5, 2.5], [2.5, 3.5]], type: :f16))
+
+      assert EMLX.greater(a, 1, :int32, :uint8) |> EMLX.to_blob() == <<0, 1>>
+    end
+
+    test "reductions cast to the output type" do
+      t = Nx.tensor([[1, 2], [3, 4]], type: :u8) |> EB.from_nx()
+
+      sum = EMLX.sum(t, [0], false, :uint32)
+      assert EMLX.scalar_type(sum) == :uint32
+      assert EMLX.to_blob(sum) == <<4::native-32, 6::native-32>>
+
+      assert EMLX.sum(t, [], false, :uint32) |> EMLX.shape() == {2, 2}
+    end
+
+    test "mixed types with broadcasting through Nx" do
+      a = Nx.tensor([[1], [2]], type: :u8)
+      b = Nx.tensor([0.5, 1.5], type: :f16)
+
+      assert_equal(Nx.add(a, b), Nx.tensor([[1.5, 2.5], [2.5, 3.5]], type: :f16))
+      assert_equal(Nx.sum(a, axes: [0]), Nx.tensor([3], type: :u32))
+    end
+  end
+
+  describe "einsum" do
+    test "contracts any number of operands" do
+      a = Nx.iota({2, 3}, type: :f32)
+      b = Nx.iota({3, 4}, type: :f32) |> Nx.divide(5)
+      c = Nx.iota({4, 2}, type: :f32) |> Nx.subtract(3)
+      refs = Enum.map([a, b, c], &EB.from_nx/1)
+
+      # The second call reuses the cached plan
+      for _ <- 1..2 do
+        assert_all_close(
+          EMLX.einsum(refs, "ij,jk,kl->il") |> EB.to_nx(),
+          a |> Nx.dot(b) |> Nx.dot(c)
+        )
+      end
+
+      assert_all_close(
+        EMLX.einsum(refs, "ij,jk,kl->li") |> EB.to_nx(),
+        a |> Nx.dot(b) |> Nx.dot(c) |> Nx.transpose()
+      )
+
+      # Labels used by a single operand are summed away
+      assert_all_close(
+        EMLX.einsum(Enum.take(refs, 2), "ij,jk->i") |> EB.to_nx(),
+        a |> Nx.dot(b) |> Nx.sum(axes: [1])
+      )
+    end
+
+    test "batch axes and native fallback" do
+      a = Nx.iota({2, 3, 4}, type: :f32)
+      b = Nx.iota({2, 4, 5}, type: :f32) |> Nx.divide(7)
+      expected = Nx.dot(a, [2], [0], b, [1], [0])
+
+      assert_all_close(
+        EMLX.einsum([EB.from_nx(a), EB.from_nx(b)], "bij,bjk->bik") |> EB.to_nx(),
+        expected
+      )
+
+      # Ellipsis specs go through mlx::core::einsum
+      assert_all_close(
+        EMLX.einsum([EB.from_nx(a), EB.from_nx(b)], "...ij,...jk->...ik") |> EB.to_nx(),
+        expected
+      )
+    end
+  end
+
+  describe "segment_reduce" do
+    test "reduces rows by segment id" do
+      data = Nx.tensor([[1.0, -2.0], [3.0, 4.0], [5.0, 0.5], [-1.0, 2.0]])
+      ids = Nx.tensor([2, 0, 2, 0])
+
+      assert_equal(
+        EMLX.segment_reduce(data, ids, 4, :sum),
+        Nx.tensor([[2.0, 6.0], [0.0, 0.0], [6.0, -1.5], [0.0, 0.0]])
+      )
+
+      assert_equal(
+        EMLX.segment_reduce(data, ids, 3, :max),
+        Nx.tensor([[3.0, 4.0], [:neg_infinity, :neg_infinity], [5.0, 0.5]])
+      )
+
+      assert_equal(
+        EMLX.segment_reduce(data, ids, 3, :min),
+        Nx.tensor([[-1.0, 2.0], [:infinity, :infinity], [1.0, -2.0]])
+      )
+
+      assert_equal(
+        EMLX.segment_reduce(data, ids, 3, :prod),
+        Nx.tensor([[-3.0, 8.0], [1.0, 1.0], [5.0, -1.0]])
+      )
+
+      assert_all_close(
+        EMLX.segment_reduce(data, ids, 3, :mean),
+        Nx.tensor([[1.0, 3.0], [0.0, 0.0], [3.0, -0.75]])
+      )
+    end
+
+    test "integer data" do
+      data = Nx.tensor([4, 7, 1, 9], type: :s32)
+      ids = Nx.tensor([1, 1, 0, 1])
+
+      assert_equal(EMLX.segment_reduce(data, ids, 2, :max), Nx.tensor([1, 9], type: :s32))
+      assert_all_close(EMLX.segment_reduce(data, ids, 2, :mean), Nx.tensor([1.0, 20 / 3]))
+
+      assert_raise ArgumentError, ~r/expected segment_ids/, fn ->
+        EMLX.segment_reduce(data, Nx.tensor([0, 1]), 2, :sum)
+      end
+    end
+
+    test "rejects out of range ids" do
+      data = Nx.tensor([1.0, 2.0, 3.0])
+
+      for ids <- [Nx.tensor([0, 2, 1]), Nx.tensor([0, -1, 1])] do
+        assert_raise ArgumentError, ~r/to be in 0..1/, fn ->
+          EMLX.segment_reduce(data, ids, 2, :sum)
+        end
+      end
+
+      assert_raise ArgumentError, ~r/to be in 0..-1/, fn ->
+        EMLX.segment_reduce(data, Nx.tensor([0, 0, 0]), 0, :max)
+      end
+    end
+  end
+
+  describe "containers" do
+    setup do
+      state = %{
+        "dense" => {Nx.iota({2, 3}, type: :f32), Nx.tensor([1.5, -2.0], type: :f16)},
+        "step" => Nx.tensor(3),
+        "host" => Nx.tensor([0.25], backend: Nx.BinaryBackend)
+      }
+
+      {:ok, state: state}
+    end
+
+    test "tree_astype casts floating point leaves", %{state: state} do
+      cast = EMLX.tree_astype(state, :bf16)
+
+      {kernel, bias} = cast["dense"]
+      assert kernel.type == {:bf, 16}
+      assert bias.type == {:bf, 16}
+      assert cast["host"].type == {:bf, 16}
+      assert cast["step"] == state["step"]
+
+      assert_equal(kernel, Nx.as_type(Nx.iota({2, 3}), :bf16))
+      assert_equal(bias, Nx.tensor([1.5, -2.0], type: :bf16))
+    end
+
+    test "tree_transfer and tree_eval", %{state: state} do
+      moved = state |> EMLX.tree_transfer(:cpu) |> EMLX.tree_eval()
+
+      # The given tensors are deallocated, so compare against new ones
+      expected = [{moved["step"], Nx.tensor(3)}, {moved["host"], Nx.tensor([0.25])}]
+
+      for {leaf, expected} <- expected do
+        assert %EMLX.Backend{ref: {:cpu, _}} = leaf.data
+        assert_equal(leaf, expected)
+      end
+
+      {kernel, _bias} = moved["dense"]
+      assert_equal(kernel, Nx.iota({2, 3}, type: :f32))
+    end
+
+    test "number leaves pass through" do
+      state = EMLX.Optim.init(:sgd, %{"w" => Nx.tensor([1.0, 2.0])})
+      assert state.step == 0
+
+      moved = EMLX.tree_transfer(state, :cpu)
+      assert moved.step == 0
+      assert_equal(moved.trace["w"], Nx.tensor([0.0, 0.0]))
+
+      cast = EMLX.tree_astype({1, Nx.tensor([1.0]), 2.5}, :f16)
+      assert {1, tensor, 2.5} = cast
+      assert tensor.type == {:f, 16}
+
+      assert EMLX.tree_eval(%{step: 3}) == %{step: 3}
+    end
+
+    test "backend_copy between EMLX devices shares the array" do
+      t = Nx.tensor([1, 2, 3])
+      copy = Nx.backend_copy(t, {EMLX.Backend, device: :cpu})
+
+      Nx.backend_deallocate(t)
+      assert_equal(copy, Nx.tensor([1, 2, 3]))
+    end
+  end
+
+  describe "batch" do
+    test "matches eager results" do
+      x = Nx.tensor([[1.0, -2.0], [3.0, 0.5]])
+      eager = x |> Nx.multiply(0.5) |> Nx.add(1) |> Nx.exp() |> Nx.sum(axes: [1])
+
+      batched =
+        EMLX.batch(fn ->
+          x |> Nx.multiply(0.5) |> Nx.add(1) |> Nx.exp() |> Nx.sum(axes: [1])
+        end)
+
+      assert is_reference(elem(batched.data.ref, 1))
+      assert_all_close(batched, eager)
+    end
+
+    test "resolves nested results and flushes on reads" do
+      x = Nx.tensor([1, 2, 3])
+
+      {a, [b]} =
+        EMLX.batch(fn ->
+          a = Nx.add(x, 1)
+          assert Nx.to_flat_list(a) == [2, 3, 4]
+          {Nx.multiply(a, 2), [Nx.greater(a, 2)]}
+        end)
+
+      assert_equal(a, Nx.tensor([4, 6, 8]))
+      assert_equal(b, Nx.tensor([0, 1, 1], type: :u8))
+    end
+
+    test "resolves tensors in maps" do
+      x = Nx.tensor([0.0, 1.0])
+
+      %{y: y, nested: %{z: z}, step: 1} =
+        EMLX.batch(fn -> %{y: Nx.exp(x), nested: %{z: Nx.negate(x)}, step: 1} end)
+
+      assert_all_close(y, Nx.tensor([1.0, :math.exp(1.0)]))
+      assert_equal(Nx.add(z, 1), Nx.tensor([1.0, 0.0]))
+    end
+
+    test "passes other tensors and structs through" do
+      binary = Nx.tensor(1, backend: Nx.BinaryBackend)
+
+      assert {^binary, 1..3, ~D[2024-01-01]} =
+               EMLX.batch(fn -> {binary, 1..3, ~D[2024-01-01]} end)
+
+      assert %{t: ^binary, r: 1..3} = EMLX.batch(fn -> %{t: binary, r: 1..3} end)
+    end
+
+    test "tensors that escape the batch raise" do
+      x = Nx.tensor([1, 2, 3])
+      parent = self()
+
+      EMLX.batch(fn ->
+        send(parent, {:escaped, Nx.add(x, 1)})
+        :ok
+      end)
+
+      assert_received {:escaped, escaped}
+
+      assert_raise ArgumentError, ~r/EMLX.batch/, fn -> Nx.add(escaped, 1) end
+    end
+  end
+
+  describe "sort and top_k" do
+    test "descending sort is stable and handles unsigned types" do
+      t = Nx.tensor([3, 1, 255, 3, 0, 1], type: :u8)
+
+      assert_equal(Nx.sort(t, direction: :desc), Nx.tensor([255, 3, 3, 1, 1, 0], type: :u8))
+
+      assert_equal(
+        Nx.argsort(t, direction: :desc, stable: true),
+        Nx.tensor([2, 0, 3, 1, 5, 4])
+      )
+
+      t = Nx.tensor([[2.0, 5.0, 2.0], [1.0, 1.0, 4.0]])
+      assert_equal(Nx.argsort(t, axis: 1, direction: :desc), Nx.tensor([[1, 0, 2], [2, 0, 1]]))
+      assert_equal(Nx.argsort(t, axis: 0, direction: :desc), Nx.tensor([[0, 0, 1], [1, 1, 0]]))
+    end
+
+    test "top_k matches a full descending sort" do
+      t = Nx.iota({2, 50}, type: :f32) |> Nx.multiply(7) |> Nx.remainder(50)
+      {values, indices} = Nx.top_k(t, k: 5)
+
+      expected = Nx.argsort(t, axis: 1, direction: :desc)[[.., 0..4]]
+
+      assert_equal(indices, expected)
+      assert_equal(values, Nx.take_along_axis(t, expected, axis: 1))
+    end
+
+    test "top_k breaks ties at the boundary by index" do
+      t = Nx.tensor([[1, 3, 2, 3, 3, 0, 3], [2, 2, 2, 2, 2, 2, 2]], type: :u8)
+      {values, indices} = Nx.top_k(t, k: 3)
+
+      expected = Nx.argsort(t, axis: 1, direction: :desc, stable: true)[[.., 0..2]]
+
+      assert_equal(indices, expected)
+      assert_equal(indices, Nx.tensor([[1, 3, 4], [0, 1, 2]]))
+      assert_equal(values, Nx.take_along_axis(t, expected, axis: 1))
+
+      assert_equal(
+        Nx.top_k(t, k: 7) |> elem(1),
+        Nx.argsort(t, axis: 1, direction: :desc, stable: true)
+      )
+    end
+
+    test "top_k validates k" do
+      t = Nx.tensor([1, 2, 3]) |> EB.from_nx()
+
+      for k <- [0, 4], fun <- [&EMLX.argtopk/3, &EMLX.topk/3] do
+        assert_raise EMLX.NIFError, ~r/between 1 and the axis size/, fn -> fun.(t, k, 0) end
+      end
+    end
+
+    test "partition" do
+      t = Nx.tensor([5, 1, 4, 2, 3]) |> EB.from_nx()
+
+      [_, _, kth | rest] = t |> EMLX.partition(2, 0) |> EB.to_nx() |> Nx.to_flat_list()
+      assert kth == 3 and Enum.all?(rest, &(&1 >= 3))
+
+      assert t |> EMLX.topk(2, 0) |> EB.to_nx() |> Nx.to_flat_list() == [5, 4]
+    end
+  end
+
+  describe "write_binary" do
+    test "writes rows into an existing tensor in place" do
+      t = Nx.broadcast(Nx.tensor(0, type: :f32), {4, 3}) |> Nx.add(0)
+      rows = Nx.tensor([[1, 2, 3], [4, 5, 6]], type: :f32) |> Nx.to_binary()
+
+      assert EB.write_binary(t, rows, [1, 0], {2, 3}) == t
+
+      assert_equal(
+        t,
+        Nx.tensor([[0, 0, 0], [1, 2, 3], [4, 5, 6], [0, 0, 0]], type: :f32)
+      )
+    end
+
+    test "writes an inner region" do
+      t = Nx.iota({3, 4}, type: :s32) |> Nx.multiply(1)
+      patch = Nx.tensor([[-1, -2], [-3, -4]], type: :s32) |> Nx.to_binary()
+
+      EB.write_binary(t, patch, [1, 1], {2, 2})
+
+      assert_equal(t, Nx.tensor([[0, 1, 2, 3], [4, -1, -2, 7], [8, -3, -4, 11]]))
+    end
+
+    test "fails when the buffer is shared" do
+      t = Nx.iota({2, 2}, type: :f32) |> Nx.add(0)
+      _view = Nx.reshape(t, {4}) |> EB.from_nx()
+
+      assert_raise EMLX.NIFError, ~r/shared/, fn ->
+        EB.write_binary(t, <<1.0::float-native-32>>, [0, 0], {1, 1})
+      end
+    end
+
+    test "validates the region" do
+      t = Nx.iota({2, 2}, type: :f32) |> Nx.add(0)
+
+      assert_raise EMLX.NIFError, ~r/out of bounds/, fn ->
+        EB.write_binary(t, <<1.0::float-native-32>>, [2, 0], {1, 1})
+      end
+
+      assert_raise EMLX.NIFError, ~r/Binary size/, fn ->
+        EB.write_binary(t, <<1.0::float-native-32>>, [0, 0], {1, 2})
+      end
+    end
+  end
+
   describe "to_binary" do
     test "for unsigned integers" do
       assert Nx.tensor(1, type: :u8) |> Nx.to_binary() == <<1::native>>
@@ -1315,5 +1988,34 @@ defmodule EMLX.NxTest do
       assert Nx.tensor(1, type: :u32) |> Nx.to_binary() == <<1::native-32>>
       assert Nx.tensor(1, type: :u64) |> Nx.to_binary() == <<1::native-64>>
     end
+
+    test "for f64 tensors" do
+      t = Nx.tensor([1.5, -2.0, 3.25], type: :f64)
+
+      assert Nx.to_binary(t) ==
+               <<1.5::float-native-64, -2.0::float-native-64, 3.25::float-native-64>>
+
+      assert Nx.to_binary(t, limit: 2) == <<1.5::float-native-64, -2.0::float-native-64>>
+    end
+
+    test "converts into a different output type while copying" do
+      t = Nx.tensor([[1.5, -2.0], [3.25, 4.0]], type: :bf16)
+      t_mx = EB.from_nx(t)
+
+      assert EMLX.to_blob(t_mx, 4, :float32) ==
+               Nx.tensor([[1.5, -2.0], [3.25, 4.0]], type: :f32) |> Nx.to_binary()
+
+      transposed_mx = t |> Nx.transpose() |> EB.from_nx()
+
+      assert EMLX.to_blob(transposed_mx, 3, :float64) ==
+               <<1.5::float-native-64, 3.25::float-native-64, -2.0::float-native-64>>
+
+      bool_mx = Nx.tensor([1, 0, 2]) |> EB.from_nx() |> EMLX.astype(:bool)
+      assert EMLX.to_blob(bool_mx, 3, :uint8) == <<1, 0, 1>>
+
+      assert_raise EMLX.NIFError, ~r/Unsupported conversion/, fn ->
+        EMLX.to_blob(t_mx, 4, :int32)
+      end
+    end
   end
 end
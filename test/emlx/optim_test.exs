@@ -0,0 +1,91 @@
+defmodule EMLX.OptimTest do
+  use EMLX.Case, async: true
+
+  alias EMLX.Optim
+
+  setup do
+    params = %{
+      "dense" => %{
+        "kernel" => Nx.iota({2, 3}, type: :f32),
+        "bias" => Nx.tensor([0.5, -0.5, 1.0])
+      },
+      "scale" => Nx.tensor(2.0)
+    }
+
+    grads = %{
+      "dense" => %{
+        "kernel" => Nx.tensor([[1.0, -2.0, 0.5], [0.0, 3.0, -1.0]]),
+        "bias" => Nx.tensor([0.1, 0.2, -0.3])
+      },
+      "scale" => Nx.tensor(-0.25)
+    }
+
+    {:ok, params: params, grads: grads}
+  end
+
+  defp leaves(container), do: Nx.Defn.Composite.flatten_list([container])
+
+  defp assert_tree_close(left, right) do
+    Enum.zip_with(leaves(left), leaves(right), &assert_all_close/2)
+  end
+
+  test "sgd with momentum", %{params: params, grads: grads} do
+    opts = [learning_rate: 0.1, momentum: 0.9, weight_decay: 0.01]
+
+    state = Optim.init(:sgd, params)
+    {p1, state} = Optim.update(:sgd, params, grads, state, opts)
+    {p2, state} = Optim.update(:sgd, p1, grads, state, opts)
+    assert state.step == 2
+
+    step = fn p, g, trace ->
+      g = Nx.add(g, Nx.multiply(p, 0.01))
+      trace = Nx.add(Nx.multiply(trace, 0.9), g)
+      {Nx.subtract(p, Nx.multiply(trace, 0.1)), trace}
+    end
+
+    expected =
+      Enum.zip_with(leaves(params), leaves(grads), fn p, g ->
+        {p1, trace} = step.(p, g, Nx.multiply(p, 0))
+        {p2, _trace} = step.(p1, g, trace)
+        p2
+      end)
+
+    assert_tree_close(p2, expected)
+    assert Map.keys(p2) == ["dense", "scale"]
+  end
+
+  test "adamw matches the reference update", %{params: params, grads: grads} do
+    opts = [learning_rate: 0.01, weight_decay: 0.1]
+
+    state = Optim.init(:adamw, params)
+    {p1, state} = Optim.update(:adamw, params, grads, state, opts)
+    {p2, _state} = Optim.update(:adamw, p1, grads, state, Keyword.put(opts, :donate, true))
+
+    step = fn p, g, mu, nu, t ->
+      mu = Nx.add(Nx.multiply(mu, 0.9), Nx.multiply(g, 0.1))
+      nu = Nx.add(Nx.multiply(nu, 0.999), Nx.multiply(Nx.multiply(g, g), 0.001))
+      m_hat = Nx.divide(mu, 1 - :math.pow(0.9, t))
+      v_hat = Nx.divide(nu, 1 - :math.pow(0.999, t))
+      update = Nx.divide(m_hat, Nx.add(Nx.sqrt(v_hat), 1.0e-8))
+      {Nx.subtract(p, Nx.multiply(Nx.add(update, Nx.multiply(p, 0.1)), 0.01)), mu, nu}
+    end
+
+    expected =
+      Enum.zip_with(leaves(params), leaves(grads), fn p, g ->
+        zero = Nx.multiply(p, 0)
+        {p1, mu, nu} = step.(p, g, zero, zero, 1)
+        {p2, _mu, _nu} = step.(p1, g, mu, nu, 2)
+        p2
+      end)
+
+    assert_tree_close(p2, expected)
+  end
+
+  test "keeps parameter types" do
+    params = {Nx.tensor([1.0, 2.0], type: :bf16)}
+    grads = {Nx.tensor([0.5, 0.5])}
+
+    {{param}, _state} = Optim.update(:adam, params, grads, Optim.init(:adam, params))
+    assert param.type == {:bf, 16}
+  end
+end
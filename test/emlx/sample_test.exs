@@ -0,0 +1,55 @@
+defmodule EMLX.SampleTest do
+  use EMLX.Case, async: true
+
+  setup do
+    {:ok, key: Nx.Random.key(42)}
+  end
+
+  test "greedy and filtered draws pick the argmax", %{key: key} do
+    logits = Nx.tensor([[0.5, 3.0, -1.0, 2.9], [4.0, 0.0, 1.0, 3.0]])
+    argmax = Nx.tensor([1, 0], type: :s32)
+
+    assert_equal(EMLX.Sample.token(logits, key, temperature: 0), argmax)
+    assert_equal(EMLX.Sample.token(logits, key, top_k: 1), argmax)
+    assert_equal(EMLX.Sample.token(logits, key, top_p: 0.01), argmax)
+  end
+
+  test "draws stay within the filters", %{key: key} do
+    logits = Nx.tile(Nx.tensor([[2.0, 1.9, 0.0, -1.0, 1.8]]), [500, 1])
+
+    tokens = EMLX.Sample.token(logits, key, top_k: 2) |> Nx.to_flat_list()
+    assert tokens |> Enum.uniq() |> Enum.sort() == [0, 1]
+
+    # Softmax of the logits is about [0.34, 0.31, 0.05, 0.02, 0.28], so
+    # the two most likely tokens are the smallest set reaching 0.6
+    tokens = EMLX.Sample.token(logits, key, top_p: 0.6) |> Nx.to_flat_list()
+    assert tokens |> Enum.uniq() |> Enum.sort() == [0, 1]
+
+    tokens = EMLX.Sample.token(logits, key, temperature: 0.5) |> Nx.to_flat_list()
+    assert Enum.all?(tokens, &(&1 in 0..4))
+  end
+
+  test "validates the options", %{key: key} do
+    logits = Nx.tensor([[0.5, 3.0]])
+
+    for opts <- [
+          [top_p: 0],
+          [top_p: -0.5],
+          [top_p: 1.5],
+          [top_p: :nan],
+          [temperature: -1.0],
+          [temperature: :nan],
+          [temperature: :infinity],
+          [top_k: -1]
+        ] do
+      assert_raise ArgumentError, fn -> EMLX.Sample.token(logits, key, opts) end
+    end
+  end
+
+  test "the key determines the draw", %{key: key} do
+    logits = Nx.iota({8, 16}, type: :f32) |> Nx.sin()
+
+    assert_equal(EMLX.Sample.token(logits, key), EMLX.Sample.token(logits, key))
+    assert EMLX.Sample.token(logits, key).shape == {8}
+  end
+end
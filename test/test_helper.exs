@@ -1,3 +1,5 @@
 Application.put_env(:nx, :default_backend, EMLX.Backend)
 
-ExUnit.start()
+exclude = [:large_memory] ++ if EMLX.float64_supported?(), do: [], else: [:float64]
+
+ExUnit.start(exclude: exclude)